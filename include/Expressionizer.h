@@ -29,19 +29,26 @@
 
 #include "MidiRoll.h"
 
+class RollCache;
+
 class Expressionizer {
 
 	public:
 		              Expressionizer               (void);
 		             ~Expressionizer               (void);
 
+		void          reset                        (void);
+
 		bool          readMidiFile                 (std::string filename);
+		bool          readMidiFile                 (std::istream& input);
+		bool          copyInput                    (const Expressionizer& source);
 		bool          writeMidiFile                (std::string filename);
+		bool          writeMidiFile                (std::ostream& output);
 
 		std::ostream& printExpression              (std::ostream& out, bool extended = false);
 		void 		     printVelocity();
 
-		void          addExpression                (void);
+		bool          addExpression                (void);
 		void          setPan                       (void);
 
 		bool          applyTrackBarWidthCorrection (void);
@@ -77,6 +84,9 @@ class Expressionizer {
 		void          setFastCrescendo             (double value);
 		void          setFastDecrescendo           (double value);
 		void          setVersion                   (std::string version);
+		void          setDate                      (const std::string& date);
+		static std::string getSoftwareDate         (void);
+		static int    getEngineVersion             (void);
 
 		double        getWelteP                    (void);
 		double        getWelteMF                   (void);
@@ -88,10 +98,23 @@ class Expressionizer {
 		double        getLeftRightDiff             (void);
 
 		void          setAcceleration              (double accelFtPerMin2);
+		void          setAccelerationMaxError      (double seconds);
+		void          setCompactOutput             (bool state = true);
+		void          removeRedundantEventsOnWrite (std::ostream* report = NULL);
+		void          setErrorStream               (std::ostream* out);
+		std::ostream& getErrorStream               (void);
+		smf::MidiRoll& getMidiData                 (void);
+		void          setExpressionCache           (RollCache* cache);
 
 
 	protected:
+		bool          prepareInput                    (void);
+		void          prepareOutput                   (void);
 		void          addMetadata                     (void);
+		bool          calculateExpression             (void);
+		std::string   getExpressionKey                (std::string& check);
+		std::string   encodeExpression                (void);
+		bool          decodeExpression                (const std::string& data);
 		bool          hasControllerInTrack            (int track, int controller);
 		void          calculateRedWelteExpression     (const std::string& option);
 		std::vector<double>*          calculateLicenseeWelteExpression(const std::string& option);
@@ -123,12 +146,27 @@ class Expressionizer {
 		bool trackbar_correction_done = false;
 		bool delete_expression_tracks = false;
 
+		// remove controller/patch/tempo messages which do not change
+		// anything when writing, and list them in redundant_report if given.
+		bool remove_redundant_events = false;
+		std::ostream* redundant_report = NULL;
+
 		// version
 		std::string m_version;
 
+		// fixed date for the @EXP_DATE metadata (current time if empty)
+		std::string m_date;
+
+		// cache of the expression curves (not used if NULL)
+		RollCache* m_expressionCache = NULL;
+
 		// default feet/minute^2 acceleration for all except red Welte rolls
 		double m_accelFtPerMin2 = 0.2;
 
+		// maximum timing error (in seconds) of the tempo messages which
+		// emulate the acceleration in the output MIDI file.
+		double m_accelMaxError = 0.001;
+
 		// left_adjust: reduce loudness of bass register (for attack velocities)
 		int left_adjust       = -5;
 
@@ -16,6 +16,8 @@
 
 #include <string>
 #include <vector>
+#include <utility>
+#include <unordered_map>
 #include <iostream>
 
 namespace smf {
@@ -33,22 +35,56 @@ class MidiRoll : public MidiFile {
 		MidiRoll&               operator=  (const MidiRoll& other);
 		MidiRoll&               operator=  (const MidiFile& other);
 
+		// reading functions (scan() reads only the header and metadata):
+		using MidiFile::read;
+		using MidiFile::scan;
+		bool                    read               (std::istream& instream) override;
+		bool                    scan               (std::istream& instream) override;
+		void                    recycle            (void) override;
+
+		// writing functions (tempo messages for acceleration are added here):
+		using MidiFile::write;
+		bool                    write              (std::ostream& out) override;
+
 		void                    setRollTempo       (double tempo,
 		                                            double dpi = 300.0);
+		void                    setTicksPerQuarterNote (int ticks) override;
 		double                  getRollTempo       (double dpi = 300.0);
 		std::vector<MidiEvent*> getTextEvents      (void);
 		std::vector<MidiEvent*> getMetadataEvents  (void);
 
 		std::string             getMetadata        (const std::string& key);
+		void                    getMetadata        (std::vector<std::pair<
+		                                            std::string, std::string>>& entries);
 		int                     setMetadata        (const std::string& key,
 		                                            const std::string& value);
+		int                     setMetadata        (const std::vector<std::pair<
+		                                            std::string, std::string>>& entries);
 
 		// tracker bar emulation:
 		void                    trackerize         (int trakerheight);
+		void                    shiftNoteOffs      (int ticks,
+		                                            bool linkedonly = false) override;
+
+		// removal of controller/patch/tempo messages which change nothing:
+		int                     removeRedundantEvents (std::ostream* report = NULL);
 
 		// acceleration emulation:
 		void                    removeAcceleration (void);
-		void                    applyAcceleration  (double accelFtPerMin2);
+		void                    applyAcceleration  (double accelFtPerMin2,
+		                                            double maxError = 0.001);
+		bool                    hasAcceleration    (void) const;
+		double                  getAcceleration    (void) const;
+		double                  getAccelerationMaxError (void) const;
+
+		// physical-time analysis functions (acceleration-aware):
+		using MidiFile::getTimeInSeconds;
+		void                    doTimeAnalysis     (void) override;
+		double                  getTimeInSeconds   (int tickvalue) override;
+		void                    getTimeInSeconds   (const std::vector<int>& ticks,
+		                                            std::vector<double>& output) override;
+		double                  getAbsoluteTickTime(double starttime) override;
+
       // tick conversions:
 		void                    convertToMillisecondTicks (void);
 
@@ -60,10 +96,48 @@ class MidiRoll : public MidiFile {
 		std::string             getMetadataMarker  (void);
 		void                    setMetadataMarker  (const std::string& value);
 
+	protected:
+		int                     getMetadataIndex   (const std::string& key);
+		void                    buildMetadataIndex (void);
+		bool                    isMetadataLine     (MidiEvent& event,
+		                                            const std::string& key);
+		bool                    updateMetadata     (const std::string& key,
+		                                            const std::string& value,
+		                                            int& tick);
+		std::string             makeMetadataLine   (const std::string& key,
+		                                            const std::string& value,
+		                                            bool newline);
+		int                     getStateKey        (MidiEvent& event, int& value);
+		double                  getStartSpeed      (void);
+		void                    stampAccelerationTimes (void);
+		void                    removeTempoMessages(void);
+		void                    setConstantTempo   (void);
+		void                    makeAccelerationTrack (MidiEventList& track);
+		bool                    fitsAccelerationTempo (int starttick,
+		                                            double startseconds,
+		                                            int endtick, int& micro);
+
 	private:
 		double m_lengthdpi           = 300.0;
 		double m_widthdpi            = 300.0;
 		std::string m_metadatamarker = "@";
+
+		// m_metadataindex == Index in the first track of the first line
+		// for each metadata key.  m_metadataevents is the number of events
+		// in the first track when the index was built (-1 if not built).
+		std::unordered_map<std::string, int> m_metadataindex;
+		int    m_metadataevents      = -1;
+
+		// m_accelerationQ == True if the roll timing follows the
+		// acceleration model rather than the tempo messages in the file.
+		bool   m_accelerationQ       = false;
+
+		// m_accelFtPerMin2 == acceleration of the roll in feet/minute^2.
+		double m_accelFtPerMin2      = 0.0;
+
+		// m_accelMaxError == maximum difference in seconds between the
+		// acceleration model and the tempo messages written to a file.
+		double m_accelMaxError       = 0.001;
 };
 
 } // end smf namespace
@@ -0,0 +1,69 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/include/RollBatch.h
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   List of rolls to convert in batch mode, read from a
+//                directory of MIDI files or from a manifest file, and
+//                converted on a pool of threads.  Each line of a manifest
+//                is either tab-separated (input file, output file, then
+//                optional key=value overrides) or a JSON object with
+//                "input", "output" and override fields (see
+//                RollSettings::setOverride()).  The largest rolls are
+//                started first, and the results are kept in the order of
+//                the input.
+//
+
+#ifndef _ROLLBATCH_H_INCLUDED
+#define _ROLLBATCH_H_INCLUDED
+
+#include "RollSettings.h"
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A roll to convert, and the result of converting it.
+class RollJob {
+	public:
+		std::string  input;
+		std::string  output;
+		RollSettings settings;
+		long         size    = 0;
+		bool         status  = false;
+		double       seconds = 0.0;
+		std::string  report;
+		std::string  errors;
+};
+
+class RollBatch {
+
+	public:
+		bool                  readManifest     (const std::string& filename,
+		                                        const std::string& outdir,
+		                                        const RollSettings& defaults,
+		                                        std::ostream& errors);
+		bool                  readDirectory    (const std::string& dirname,
+		                                        const std::string& outdir,
+		                                        const RollSettings& defaults,
+		                                        std::ostream& errors);
+		void                  convert          (int threadcount, RollCache* cache,
+		                                        bool reportQ);
+		std::vector<RollJob>& getJobs          (void);
+
+		static bool           isDirectory      (const std::string& path);
+		static bool           parseJsonLine    (const std::string& line,
+		                                        std::vector<std::pair<std::string,
+		                                        std::string>>& fields);
+		static std::string    getOutputName    (const std::string& input,
+		                                        const std::string& outdir);
+
+	private:
+		std::vector<RollJob> m_jobs;
+};
+
+#endif /* _ROLLBATCH_H_INCLUDED */
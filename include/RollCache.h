@@ -0,0 +1,97 @@
+//
+// Creation Date: Sun Oct 18 21:40:27 PDT 2026
+// Last Modified: Sun Oct 18 21:40:27 PDT 2026
+// Filename:      midi2exp/include/RollCache.h
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   On-disk cache of converted rolls.  Each entry is the
+//                output MIDI file for a key made from a hash of the input
+//                MIDI file and of the conversion settings, so a roll
+//                which has already been converted with the same settings
+//                does not need to be parsed again.  An entry starts with
+//                the length of the input and a hash of the settings,
+//                which are checked when it is looked up.  The least recently
+//                used entries are removed when the cache gets too large.
+//                Lookups and stores can be done from several threads.
+//                The entries can also be kept in memory, with or without
+//                a directory.
+//
+
+#ifndef _ROLLCACHE_H_INCLUDED
+#define _ROLLCACHE_H_INCLUDED
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+class RollCache {
+
+	public:
+		                    RollCache          (void);
+		                   ~RollCache          ();
+
+		bool                setDirectory       (const std::string& directory);
+		const std::string&  getDirectory       (void) const;
+		void                setMaxSize         (long long bytes);
+		long long           getMaxSize         (void) const;
+		void                keepInMemory       (bool state = true);
+		bool                isActive           (void) const;
+		void                setErrorStream     (std::ostream* out);
+		std::ostream&       getErrorStream     (void) const;
+
+		static std::string  getHash            (const std::string& data);
+		static std::string  getKey             (const std::string& input,
+		                                        const std::string& settings);
+		static std::string  getCheck           (const std::string& input,
+		                                        const std::string& settings);
+
+		bool                lookup             (const std::string& key,
+		                                        const std::string& check,
+		                                        std::string& output);
+		bool                store              (const std::string& key,
+		                                        const std::string& check,
+		                                        const std::string& output);
+		int                 evict              (void);
+
+		long                getHits            (void) const;
+		long                getMisses          (void) const;
+		long                getStores          (void) const;
+		long                getEvictions       (void) const;
+		std::ostream&       printStatistics    (std::ostream& out) const;
+
+	protected:
+		std::string         getEntryName       (const std::string& key) const;
+		static std::string  getEntryHeader     (const std::string& check);
+
+	private:
+		// m_directory == Directory of the cache entries (empty if no cache).
+		std::string m_directory;
+
+		// m_maxsize == Size in bytes to which the cache is reduced by evict().
+		long long m_maxsize = 1024LL * 1024 * 1024;
+
+		// m_memoryQ == Keep the entries in m_entries as well as on disk
+		// (with their headers).  Entries in memory are not evicted.
+		bool m_memoryQ = false;
+		std::map<std::string, std::string> m_entries;
+		std::mutex m_entrymutex;
+
+		// m_errorstream == Destination of error messages, or NULL to
+		// discard them.
+		std::ostream* m_errorstream = &std::cerr;
+
+		// statistics:
+		std::atomic<long> m_hits;
+		std::atomic<long> m_misses;
+		std::atomic<long> m_stores;
+		std::atomic<long> m_evictions;
+};
+
+#endif /* _ROLLCACHE_H_INCLUDED */
+
+
+
@@ -0,0 +1,44 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/include/RollFanout.h
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Several output variants of one input roll, which is
+//                read and analyzed only once.  Each line of a variants
+//                file is an output file followed by key=value overrides
+//                separated by spaces or tabs (see RollSettings::
+//                setOverrides()).  Variants with the same expression
+//                settings share one calculation of the expression curves,
+//                and the variants are processed and written on a pool of
+//                threads.
+//
+
+#ifndef _ROLLFANOUT_H_INCLUDED
+#define _ROLLFANOUT_H_INCLUDED
+
+#include "RollBatch.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+class RollFanout {
+
+	public:
+		bool                  readVariants     (const std::string& filename,
+		                                        const std::string& input,
+		                                        const RollSettings& defaults,
+		                                        std::ostream& errors);
+		void                  convert          (int threadcount,
+		                                        RollCache* expressionCache);
+		std::vector<RollJob>& getJobs          (void);
+
+	private:
+		std::string          m_input;
+		std::vector<RollJob> m_jobs;
+};
+
+#endif /* _ROLLFANOUT_H_INCLUDED */
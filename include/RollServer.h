@@ -0,0 +1,106 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/include/RollServer.h
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Server which converts rolls sent over a Unix domain
+//                socket or through standard input and output, which
+//                avoids starting a process for each roll.  The rolls are
+//                converted on a pool of threads, each of which reuses its
+//                Expressionizer while the settings stay the same.
+//
+// Numbers in the framed protocol are 32-bit unsigned big-endian integers,
+// and a string is its length followed by its bytes.  A request is an id, a
+// string of key=value overrides separated by spaces or tabs (see
+// RollSettings::setOverrides()), and a string of MIDI file bytes.  A
+// response is the id of the request, a status (0 = ok, 1 = error), the
+// microseconds spent waiting for a thread and converting, and a string of
+// either the output MIDI bytes or the error messages.  Responses may be
+// returned in a different order than the requests.  A request with "stats"
+// as its settings returns the statistics of the server as text.
+//
+
+#ifndef _ROLLSERVER_H_INCLUDED
+#define _ROLLSERVER_H_INCLUDED
+
+#include "RollSettings.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class RollServer {
+
+	public:
+		bool                run                (const std::string& path,
+		                                        int threadcount,
+		                                        std::ostream& errors);
+		void                setDefaults        (const RollSettings& defaults);
+		void                setCache           (RollCache* cache);
+		std::string         getStatistics      (void);
+
+		static bool         readFrameNumber    (int fd, uint32_t& value);
+		static bool         readFrameString    (int fd, std::string& value);
+		static void         appendFrameNumber  (std::string& data,
+		                                        uint32_t value);
+
+	protected:
+		// The output side of a client connection.  A socket is closed after
+		// the last response to it has been sent.
+		class Connection {
+			public:
+				~Connection();
+				int        outfd  = -1;
+				bool       closeQ = false;
+				std::mutex writeMutex;
+		};
+
+		// A roll to convert.
+		class Request {
+			public:
+				uint32_t    id = 0;
+				std::string params;
+				std::string midi;
+				std::shared_ptr<Connection> connection;
+				std::chrono::steady_clock::time_point received;
+		};
+
+		void                serveConnection    (int infd,
+		                                        std::shared_ptr<Connection> connection);
+		void                serveRequests      (void);
+		void                sendResponse       (Connection& connection,
+		                                        uint32_t id, uint32_t status,
+		                                        double queued, double work,
+		                                        const std::string& payload);
+
+	private:
+		RollSettings m_defaults;
+		RollCache*   m_cache = NULL;  // converted rolls (if not NULL)
+
+		// requests waiting for a thread:
+		std::mutex              m_lock;
+		std::condition_variable m_ready;
+		std::deque<Request>     m_requests;
+		bool                    m_closed = false;
+
+		// statistics:
+		int    m_active     = 0;     // requests being converted
+		long   m_count      = 0;     // finished requests
+		long   m_errors     = 0;     // requests which failed
+		long   m_arrivals   = 0;
+		double m_depthSum   = 0.0;   // queue depth when each request arrived
+		int    m_maxDepth   = 0;
+		double m_queueSum   = 0.0;   // seconds waiting for a thread
+		double m_workSum    = 0.0;   // seconds converting
+		double m_maxLatency = 0.0;
+};
+
+#endif /* _ROLLSERVER_H_INCLUDED */
@@ -0,0 +1,94 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/include/RollSettings.h
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Settings for converting one roll (the options of
+//                midi2exp), and the steps to convert a roll with them.
+//                The settings can be changed with key=value overrides,
+//                as given in a batch manifest, a fan-out variant or a
+//                server request: "type" (red, green, licensee, 88-note
+//                or duo-art), "tempo", "accel", and "remove-tracks",
+//                "adjust-holes" and "compact" (0 or 1).
+//
+// A roll type always uses its standard tempo, as a roll type option does
+// in midi2exp even when -t is also given, so a tempo is only used for
+// rolls without a type.  The same rule applies to the options of midi2exp,
+// to overrides and to the parameters of the C interface (m2e.h).
+//
+
+#ifndef _ROLLSETTINGS_H_INCLUDED
+#define _ROLLSETTINGS_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Expressionizer;
+class RollCache;
+
+class RollSettings {
+
+	public:
+		bool                setOverride        (const std::string& key,
+		                                        const std::string& value);
+		bool                setOverrides       (const std::string& params,
+		                                        std::ostream& errors);
+
+		std::string         getKey             (void) const;
+		std::string         getCurveKey        (void) const;
+
+		void                setupRoll          (Expressionizer& creator,
+		                                        std::ostream* log) const;
+		bool                expressRoll        (Expressionizer& creator,
+		                                        std::ostream* log,
+		                                        std::ostream* report) const;
+		bool                convertRoll        (const std::string& input,
+		                                        const std::string& output,
+		                                        std::ostream* log,
+		                                        std::ostream* report,
+		                                        std::ostream& errors,
+		                                        RollCache* cache,
+		                                        std::ostream* expression = NULL,
+		                                        bool extendedQ = false) const;
+
+		static bool         writeOutputFile    (const std::string& filename,
+		                                        const std::string& data,
+		                                        std::ostream& errors);
+		static std::string  getReproducibleDate(void);
+
+		std::string type            = "red";  // red, green, licensee, 88-note, duo-art
+		bool        typeTempo       = false;  // use the standard tempo of the roll type
+		bool        tempoQ          = false;
+		double      tempo           = 100.0;
+		bool        accelQ          = false;
+		double      accel           = 0.2;
+		bool        accelMaxErrorQ  = false;
+		double      accelMaxError   = 1.0;    // milliseconds
+		double      punchDiameter   = 21.5;
+		double      trackerDiameter = 16.7;
+		double      punchFraction   = 0.75;
+		bool        removeTracks    = false;
+		bool        adjustHoles     = false;
+		bool        compact         = false;
+		bool        removeRedundant = false;
+		bool        versionQ        = false;
+		std::string version;
+		std::string date;                     // fixed @EXP_DATE (current time if empty)
+		RollCache*  expressionCache = NULL;   // cache of expression curves (if any)
+		// expression parameters (used if given):
+		std::vector<std::pair<std::string, double>> parameters;
+
+	protected:
+		bool                convertCachedRoll  (const std::string& input,
+		                                        const std::string& output,
+		                                        std::ostream* log,
+		                                        std::ostream& errors,
+		                                        RollCache& cache) const;
+};
+
+#endif /* _ROLLSETTINGS_H_INCLUDED */
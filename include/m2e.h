@@ -0,0 +1,90 @@
+//
+// Creation Date: Sun Oct 18 21:30:04 PDT 2026
+// Last Modified: Sun Oct 18 21:30:04 PDT 2026
+// Filename:      midi2exp/include/m2e.h
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C99 / C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   C interface to the expression engine for use from other
+//                languages (through FFI) with the m2e shared library.
+//                A roll handle converts MIDI files in memory with the same
+//                settings as the midi2exp program.  Each handle must only
+//                be used by one thread at a time, but separate handles can
+//                be used in parallel.
+//
+// Typical use:
+//
+//    m2e_roll* roll = m2e_create();
+//    m2e_set_param(roll, "type", "green");
+//    if (m2e_process_buffer(roll, input, size, &output, &outsize) != 0) {
+//       fprintf(stderr, "%s", m2e_get_error(roll));
+//    }
+//    ... (output is valid until the next call with roll)
+//    m2e_free(roll);
+//
+// Functions which return int give 0 on success and -1 on failure.  Only
+// new functions will be added to this interface: existing functions and
+// the m2e_note structure will not change while M2E_ABI_VERSION is 1.
+//
+
+#ifndef _M2E_H_INCLUDED
+#define _M2E_H_INCLUDED
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+	#ifdef M2E_BUILD
+		#define M2E_API __declspec(dllexport)
+	#else
+		#define M2E_API __declspec(dllimport)
+	#endif
+#else
+	#define M2E_API __attribute__((visibility("default")))
+#endif
+
+#define M2E_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct m2e_roll m2e_roll;
+
+// A note-on in the output roll (register track 1 = bass, 2 = treble).
+typedef struct m2e_note {
+	int    track;
+	int    key;
+	int    velocity;
+	int    tick;
+	double seconds;
+} m2e_note;
+
+M2E_API int                  m2e_get_abi_version  (void);
+
+M2E_API m2e_roll*            m2e_create           (void);
+M2E_API void                 m2e_free             (m2e_roll* roll);
+
+M2E_API int                  m2e_set_param        (m2e_roll* roll,
+                                                   const char* name,
+                                                   const char* value);
+M2E_API int                  m2e_process_buffer   (m2e_roll* roll,
+                                                   const unsigned char* input,
+                                                   size_t size,
+                                                   const unsigned char** output,
+                                                   size_t* outsize);
+M2E_API const char*          m2e_get_error        (m2e_roll* roll);
+
+M2E_API int                  m2e_get_note_count   (m2e_roll* roll);
+M2E_API int                  m2e_get_notes        (m2e_roll* roll,
+                                                   m2e_note* notes,
+                                                   int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _M2E_H_INCLUDED */
+
+
+
@@ -49,6 +49,8 @@ class Binasc {
 		void                 setMidiOn               (void);
 		void                 setMidiOff              (void);
 		int                  getMidi                 (void);
+		void                 setErrorStream          (std::ostream* out);
+		std::ostream&        getErrorStream          (void);
 
 		// functions for converting into a binary file:
 		int                  writeToBinary           (const std::string& outfile,
@@ -105,6 +107,7 @@ class Binasc {
 		int m_midiQ;        // output ASCII data as parsed MIDI file.
 		int m_maxLineLength;// number of character in ASCII output on a line.
 		int m_maxLineBytes; // number of hex bytes in ASCII output on a line.
+		std::ostream* m_errorstream; // error messages, or NULL to discard.
 
 	private:
 		// helper functions for reading ASCII content to conver to binary:
@@ -61,6 +61,9 @@ class MidiEvent : public MidiMessage {
 	private:
 		MidiEvent* m_eventlink;  // used to match note-ons and note-offs
 
+	// MidiEventList::linkNotePairs() uses m_eventlink of unmatched note-ons
+	friend class MidiEventList;
+
 };
 
 } // end of namespace smf
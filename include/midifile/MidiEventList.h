@@ -14,6 +14,7 @@
 #define _MIDIEVENTLIST_H_INCLUDED
 
 #include "MidiEvent.h"
+#include <atomic>
 #include <vector>
 
 namespace smf {
@@ -42,11 +43,14 @@ class MidiEventList {
 		int              getSize            (void) const;
 		int              size               (void) const;
 		void             removeEmpties      (void);
-		int              linkNotePairs      (void);
+		void             recycle            (void);
+		int              linkNotePairs      (bool notesonly = false);
+		int              linkAppendedNotePairs (void);
 		int              linkEventPairs     (void);
 		void             clearLinks         (void);
 		void             clearSequence      (void);
 		int              markSequence       (int sequence = 1);
+		bool             hasRawData         (void) const;
 
 		int              push               (MidiEvent& event);
 		int              push_back          (MidiEvent& event);
@@ -64,6 +68,35 @@ class MidiEventList {
 
 	private:
 		void             sort                (void);
+		void             shiftNoteOffs       (int ticks, bool linkedonly);
+		void             resetLinkState      (void);
+		MidiEvent*       getSpareEvent       (void);
+		static int       getControllerLinkSlot (int controller);
+
+		// m_rawdata == Original bytes of a track which was not parsed
+		// when reading the file (see MidiFile::read()).
+		std::vector<uchar>      m_rawdata;
+
+		// m_spareevents == Events removed from the list which are kept
+		// for reuse by append() (see recycle()).
+		std::vector<MidiEvent*> m_spareevents;
+
+		// m_sortbuffer == Work space for merging in sort(), kept between
+		// sorts.
+		std::vector<MidiEvent*> m_sortbuffer;
+
+		// State saved for incremental linking: the number of events
+		// linked so far, the last linked event (to detect changes to the
+		// list), the unmatched note-ons/controller on-states, and whether
+		// controllers are linked.
+		int                     m_linkedcount   = 0;
+		MidiEvent*              m_linkedlast    = NULL;
+		std::vector<MidiEvent*> m_pendinglinks;
+		bool                    m_linknotesonly = false;
+
+		// m_sharecount == Number of MidiFiles using the list (see
+		// MidiFile::operator=()).
+		std::atomic<int>        m_sharecount {1};
 
 	// MidiFile class calls sort()
 	friend class MidiFile;
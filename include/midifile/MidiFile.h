@@ -19,7 +19,9 @@
 #include <vector>
 #include <string>
 #include <istream>
+#include <iostream>
 #include <fstream>
+#include <functional>
 
 #define TIME_STATE_DELTA       0
 #define TIME_STATE_ABSOLUTE    1
@@ -29,10 +31,11 @@
 
 namespace smf {
 
-class _TickTime {
+class _TempoSegment {
 	public:
-		int    tick;
-		double seconds;
+		int    tick;            // starting tick of the tempo
+		double seconds;         // time in seconds at the starting tick
+		double secondsPerTick;  // duration of each tick in the segment
 };
 
 
@@ -44,16 +47,24 @@ class MidiFile {
 		               MidiFile                    (const MidiFile& other);
 		               MidiFile                    (MidiFile&& other);
 
-		              ~MidiFile                    ();
+		virtual       ~MidiFile                    ();
 
 		MidiFile&      operator=                   (const MidiFile& other);
 		MidiFile&      operator=                   (MidiFile&& other);
 
 		// reading/writing functions:
 		bool           read                        (const std::string& filename);
-		bool           read                        (std::istream& instream);
+		virtual bool   read                        (std::istream& instream);
+		bool           read                        (const std::string& filename,
+		                                            const std::vector<bool>& trackmask,
+		                                            bool keepraw = false);
+		bool           read                        (std::istream& instream,
+		                                            const std::vector<bool>& trackmask,
+		                                            bool keepraw = false);
+		bool           scan                        (const std::string& filename);
+		virtual bool   scan                        (std::istream& instream);
 		bool           write                       (const std::string& filename);
-		bool           write                       (std::ostream& out);
+		virtual bool   write                       (std::ostream& out);
 		bool           writeHex                    (const std::string& filename,
 		                                            int width = 25);
 		bool           writeHex                    (std::ostream& out,
@@ -63,6 +74,16 @@ class MidiFile {
 		bool           writeBinascWithComments     (const std::string& filename);
 		bool           writeBinascWithComments     (std::ostream& out);
 		bool           status                      (void) const;
+		void           setCompactEncoding          (bool state = true);
+		bool           getCompactEncoding          (void) const;
+		void           setErrorStream              (std::ostream* out);
+		std::ostream&  getErrorStream              (void) const;
+
+		// parallel processing of tracks:
+		void           setThreadCount              (int count);
+		int            getThreadCount              (void) const;
+		void           setParallelThreshold        (int events);
+		int            getParallelThreshold        (void) const;
 
 		// track-related functions:
 		const MidiEventList& operator[]            (int aTrack) const;
@@ -70,6 +91,7 @@ class MidiFile {
 		int              getTrackCount             (void) const;
 		int              getNumTracks              (void) const;
 		int              size                      (void) const;
+		bool             isTrackShared             (int track) const;
 		void             removeEmpties             (void);
 
 		// tick-related functions:
@@ -112,22 +134,27 @@ class MidiFile {
 		void             setMillisecondTicks       (void);
 		int              getTicksPerQuarterNote    (void) const;
 		int              getTPQ                    (void) const;
-		void             setTicksPerQuarterNote    (int ticks);
+		virtual void     setTicksPerQuarterNote    (int ticks);
 		void             setTPQ                    (int ticks);
 
 		// physical-time analysis functions:
-		void             doTimeAnalysis            (void);
+		virtual void     doTimeAnalysis            (void);
 		double           getTimeInSeconds          (int aTrack, int anIndex);
-		double           getTimeInSeconds          (int tickvalue);
-		double           getAbsoluteTickTime       (double starttime);
+		virtual double   getTimeInSeconds          (int tickvalue);
+		virtual void     getTimeInSeconds          (const std::vector<int>& ticks,
+		                                            std::vector<double>& output);
+		virtual double   getAbsoluteTickTime       (double starttime);
 		int              getFileDurationInTicks    (void);
 		double           getFileDurationInQuarters (void);
 		double           getFileDurationInSeconds  (void);
 
 		// note-analysis functions:
-		int              linkNotePairs             (void);
+		int              linkNotePairs             (bool notesonly = false);
+		int              linkAppendedNotePairs     (void);
 		int              linkEventPairs            (void);
 		void             clearLinks                (void);
+		virtual void     shiftNoteOffs             (int ticks,
+		                                            bool linkedonly = false);
 
 		// filename functions:
 		void             setFilename               (const std::string& aname);
@@ -145,6 +172,7 @@ class MidiFile {
 		void             allocateEvents            (int track, int aSize);
 		void             erase                     (void);
 		void             clear                     (void);
+		virtual void     recycle                   (void);
 		void             clear_no_deallocate       (void);
 
 		// MIDI message adding convenience functions:
@@ -243,7 +271,12 @@ class MidiFile {
 		                                              double value);
 
 	protected:
-		// m_events == Lists of MidiEvents for each MIDI file track.
+		bool             writeFile                 (std::ostream& out,
+		                                            const MidiEventList* firsttrack);
+		static void      sortEvents                (MidiEventList& events);
+
+		// m_events == Lists of MidiEvents for each MIDI file track.  The
+		// lists are shared with copies of the file until they are changed.
 		std::vector<MidiEventList*> m_events;
 
 		// m_ticksPerQuarterNote == A value for the MIDI file header
@@ -268,11 +301,12 @@ class MidiFile {
 		// the object.
 		std::string m_readFileName;
 
-		// m_timemapvalid ==
+		// m_timemapvalid == True if m_timemap and the MidiEvent::seconds
+		// values are up to date with the tempo messages.
 		bool m_timemapvalid = false;
 
-		// m_timemap ==
-		std::vector<_TickTime> m_timemap;
+		// m_timemap == List of tempo segments in tick order, starting at tick 0.
+		std::vector<_TempoSegment> m_timemap;
 
 		// m_rwstatus == True if last read was successful, false if a problem.
 		bool m_rwstatus = true;
@@ -280,22 +314,78 @@ class MidiFile {
 		// m_linkedEventQ == True if link analysis has been done.
 		bool m_linkedEventsQ = false;
 
+		// m_sparetracks == Empty track lists kept for reuse (see recycle()).
+		std::vector<MidiEventList*> m_sparetracks;
+
+		// m_compactencoding == True if running status and note-on messages
+		// for note-offs are used when writing.
+		bool m_compactencoding = false;
+
+		// m_threadcount == Maximum number of threads for processing
+		// tracks in parallel.
+		int m_threadcount = 1;
+
+		// m_parallelthreshold == Minimum number of events in the file for
+		// processing tracks in parallel.
+		int m_parallelthreshold = 10000;
+
+		// m_errorstream == Destination of error and warning messages,
+		// or NULL to discard them.
+		std::ostream* m_errorstream = &std::cerr;
+
 	private:
 		int        extractMidiData                 (std::istream& inputfile,
 		                                            std::vector<uchar>& array,
 		                                            uchar& runningCommand);
 		ulong      readVLValue                     (std::istream& inputfile);
+		bool       readStream                      (std::istream& input,
+		                                            const std::vector<bool>* trackmask,
+		                                            bool keepraw);
+		bool       readHeaderChunk                 (std::istream& input,
+		                                            int& tracks);
+		bool       readTrackChunkHeader            (std::istream& input,
+		                                            ulong& length);
+		bool       readTracks                      (std::istream& input,
+		                                            const std::vector<bool>& selected,
+		                                            bool keepraw);
+		bool       readTrackChunks                 (std::istream& input, int tracks,
+		                                            std::string& data);
+		bool       readTracksParallel              (const std::string& data,
+		                                            const std::vector<bool>& selected,
+		                                            bool keepraw);
+		bool       readTrackEvents                 (std::istream& input,
+		                                            MidiEventList& events,
+		                                            int track, ulong length,
+		                                            bool textonly);
+		bool       skipTrackChunk                  (std::istream& input,
+		                                            ulong length);
 		ulong      unpackVLV                       (uchar a = 0, uchar b = 0,
 		                                            uchar c = 0, uchar d = 0,
 		                                            uchar e = 0);
 		void       writeVLValue                    (long aValue,
 		                                            std::vector<uchar>& data);
+		void       allocateTracks                  (int tracks);
+		MidiEventList* getSpareTrack               (void);
+		void       ownTrack                        (int track);
+		void       ownTracks                       (void);
+		static void releaseTrack                   (MidiEventList* track);
+		bool       isParallel                      (void) const;
+		void       forEachTrack                    (const std::function<void(int)>& function,
+		                                            bool parallel);
+		void       encodeTrack                     (const MidiEventList& events,
+		                                            std::vector<uchar>& trackdata);
+		void       encodeCompactMessage            (const MidiMessage& message,
+		                                            uchar& runningstatus,
+		                                            std::vector<uchar>& trackdata);
+		void       writeTrackChunk                 (std::ostream& out,
+		                                            const std::vector<uchar>& trackdata);
 		int        makeVLV                         (uchar *buffer, int number);
-		static int ticksearch                      (const void* A, const void* B);
-		static int secondsearch                    (const void* A, const void* B);
 		void       buildTimeMap                    (void);
-		double     linearTickInterpolationAtSecond (double seconds);
-		double     linearSecondInterpolationAtTick (int ticktime);
+		void       rescaleTimeMap                  (double factor);
+		int        getTempoSegmentAtTick           (int tickvalue) const;
+		int        getTempoSegmentAtTick           (int tickvalue,
+		                                            int startindex) const;
+		int        getTempoSegmentAtSecond         (double seconds) const;
 };
 
 } // end of namespace smf
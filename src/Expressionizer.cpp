@@ -12,17 +12,37 @@
 //
 
 #include "Expressionizer.h"
+#include "RollCache.h"
 
+#include <stdint.h>
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <ctime>
+#include <chrono>
+#include <cstring>
+#include <mutex>
 
 using namespace std;
 using namespace smf;
 
+static void appendNumber         (std::string& data, double value);
+static void appendNumber         (std::string& data, int value);
+static bool readNumber           (const std::string& data, size_t& position,
+                                  double& value);
+static void appendVariableLength (std::string& data, uint64_t value);
+static bool readVariableLength   (const std::string& data, size_t& position,
+                                  uint64_t& value);
+
+// Version of the output of the expression engine, which is part of the
+// keys of cached rolls and expression curves.  Increment it whenever a
+// change to the library (Expressionizer, MidiRoll or the midifile classes)
+// changes the output for any roll, so that old cache entries are not used.
+static const int EngineVersion = 1;
+
 
 //////////////////////////////
 //
@@ -256,6 +276,36 @@ Expressionizer::~Expressionizer(void) {
 }
 
 
+
+//////////////////////////////
+//
+// Expressionizer::reset -- Remove the current roll so that another one
+//    can be processed with the same settings.  The memory used for the
+//    MIDI events and the expression timelines is kept for the next roll.
+//
+
+void Expressionizer::reset(void) {
+    midi_data.recycle();
+    trackbar_correction_done = false;
+
+    exp_bass.clear();
+    isMF_bass.clear();
+    isSlowC_bass.clear();
+    isFastC_bass.clear();
+    isFastD_bass.clear();
+    step_bass.clear();
+    pressure_bass.clear();
+
+    exp_treble.clear();
+    isMF_treble.clear();
+    isSlowC_treble.clear();
+    isFastC_treble.clear();
+    isFastD_treble.clear();
+    step_treble.clear();
+    pressure_treble.clear();
+}
+
+
 //////////////////////////////
 //
 // Expressionizer::setAcceleration -- Set acceleration in feet per minute^2.
@@ -271,14 +321,134 @@ void Expressionizer::setAcceleration(double accelFtPerMin2) {
 
 
 
+//////////////////////////////
+//
+// Expressionizer::setAccelerationMaxError -- Set the maximum timing error
+//    in seconds allowed for the tempo messages emulating acceleration in
+//    the output MIDI file.
+//
+
+void Expressionizer::setAccelerationMaxError(double seconds) {
+    if (seconds <= 0.0) {
+        return;
+    }
+
+    m_accelMaxError = seconds;
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::setCompactOutput -- Write the output MIDI file with
+//    running status and velocity-0 note-ons for note-offs, which makes
+//    the file smaller without changing the music.
+//
+
+void Expressionizer::setCompactOutput(bool state) {
+    midi_data.setCompactEncoding(state);
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::setErrorStream -- Set the stream for error and warning
+//    messages about the roll (std::cerr by default), or NULL to discard
+//    them.  Each Expressionizer has its own stream, so several rolls can be
+//    processed at the same time without mixing their messages.
+//
+
+void Expressionizer::setErrorStream(std::ostream* out) {
+    midi_data.setErrorStream(out);
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::getErrorStream -- Return the stream for error and
+//    warning messages.
+//
+
+std::ostream& Expressionizer::getErrorStream(void) {
+    return midi_data.getErrorStream();
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::getMidiData -- Return the roll being processed, such
+//    as for reading the note velocities after adding expression.
+//
+
+MidiRoll& Expressionizer::getMidiData(void) {
+    return midi_data;
+}
+
+
+
 //////////////////////////////
 //
 // Expressionizer::addExpression -- Add expression velocities to a MIDI file.
+//    Returns false if the roll type is not known.
 //
 
-void Expressionizer::addExpression(void) {
+bool Expressionizer::addExpression(void) {
     setPan();
-    midi_data.applyAcceleration(m_accelFtPerMin2);
+    midi_data.applyAcceleration(m_accelFtPerMin2, m_accelMaxError);
+
+    string key;
+    string check;
+    bool cached = false;
+    if (m_expressionCache) {
+        key = getExpressionKey(check);
+        string data;
+        cached = m_expressionCache->lookup(key, check, data)
+                && decodeExpression(data);
+    }
+    if (!cached) {
+        if (!calculateExpression()) {
+            return false;
+        }
+        if (m_expressionCache) {
+            m_expressionCache->store(key, check, encodeExpression());
+        }
+    }
+
+    applyExpression("left_hand");
+    applyExpression("right_hand");
+
+    if (roll_type == "red") {
+        addSustainPedallingLockAndCancel(treble_exp_track, PedalOnKey, PedalOffKey);
+        addSoftPedallingLockAndCancel(bass_exp_track, SoftOnKey, SoftOffKey);
+    } else if (roll_type == "licensee") {
+        addSustainPedallingLockAndCancel(treble_exp_track, PedalOnKey, PedalOffKey);
+        addSoftPedallingLockAndCancel(bass_exp_track, SoftOnKey, SoftOffKey);
+    } else if (roll_type == "green") {
+        addSustainPedalling(bass_exp_track, PedalOnKey);
+        addSoftPedalling(treble_exp_track, SoftOnKey);
+    } else if (roll_type == "duo-art") {
+        addSustainPedalling(treble_exp_track, PedalOnKey);
+        addSoftPedalling(bass_exp_track, SoftOnKey);
+    } else if (roll_type == "88-note"){
+        addSustainPedalling(bass_exp_track, PedalOnKey);
+    }
+
+    return true;
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::calculateExpression -- Calculate the expression curves
+//    of both hands from the expression tracks.  Returns false if the roll
+//    type is not known.
+//
+
+bool Expressionizer::calculateExpression(void) {
     if (roll_type == "red") {
         calculateRedWelteExpression("left_hand");
         calculateRedWelteExpression("right_hand");
@@ -296,29 +466,188 @@ void Expressionizer::addExpression(void) {
         calculateDuoArtExpression("left_hand");
         calculateDuoArtExpression("right_hand");
     } else {
-        cerr << "Don't know roll type: " << roll_type << endl;
-        exit(1);
+        getErrorStream() << "Don't know roll type: " << roll_type << endl;
+        return false;
     }
+    return true;
+}
 
-    applyExpression("left_hand");
-    applyExpression("right_hand");
 
-    if (roll_type == "red") {
-        addSustainPedallingLockAndCancel(treble_exp_track, PedalOnKey, PedalOffKey);
-        addSoftPedallingLockAndCancel(bass_exp_track, SoftOnKey, SoftOffKey);
-    } else if (roll_type == "licensee") {
-        addSustainPedallingLockAndCancel(treble_exp_track, PedalOnKey, PedalOffKey);
-        addSoftPedallingLockAndCancel(bass_exp_track, SoftOnKey, SoftOffKey);
-    } else if (roll_type == "green") {
-        addSustainPedalling(bass_exp_track, PedalOnKey);
-        addSoftPedalling(treble_exp_track, SoftOnKey);
-    } else if (roll_type == "duo-art") {
-        addSustainPedalling(treble_exp_track, PedalOnKey);
-        addSoftPedalling(bass_exp_track, SoftOnKey);
-    } else if (roll_type == "88-note"){
-        addSustainPedalling(bass_exp_track, PedalOnKey);
+
+//////////////////////////////
+//
+// Expressionizer::setExpressionCache -- Keep the expression curves of the
+//    rolls in a cache, so that a roll with the same expression tracks,
+//    timing and expression parameters does not need its curves to be
+//    calculated again.  The cache must stay valid while this object uses
+//    it (NULL stops using a cache).  Warnings from the calculation of the
+//    curves are not repeated when they come from the cache.
+//
+
+void Expressionizer::setExpressionCache(RollCache* cache) {
+    m_expressionCache = cache;
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::getExpressionKey -- Return the cache key of the
+//    expression curves for the current roll: a hash of the note-ons on
+//    the expression tracks (with their times after acceleration), the
+//    length of the roll, the expression parameters of the roll type and
+//    the version of the engine (see getEngineVersion()).  The check to store with the entry (see RollCache::getCheck()) is
+//    returned in check.
+//
+
+std::string Expressionizer::getExpressionKey(std::string& check) {
+    string data;
+    data += "expression-curves 1\n";
+    data += to_string(getEngineVersion());
+    data += "\n";
+    data += roll_type;
+    data += "\n";
+    int exp_length = midi_data.getFileDurationInSeconds() * 1000 + 1;
+    appendNumber(data, exp_length);
+
+    if ((roll_type == "88-note") || (roll_type == "duo-art")) {
+        appendNumber(data, note_normal88);
+        appendNumber(data, snake_f);
+        appendNumber(data, snake_gracetime);
+        appendNumber(data, Snakebite_bass);
+        appendNumber(data, Snakebite_treble);
+    } else {
+        appendNumber(data, welte_p);
+        appendNumber(data, welte_mf);
+        appendNumber(data, welte_f);
+        appendNumber(data, welte_loud);
+        appendNumber(data, slow_step);
+        appendNumber(data, fastC_step);
+        appendNumber(data, fastD_step);
+    }
+    if (roll_type == "duo-art") {
+        int volumes[8] = {BassVolume1, BassVolume2, BassVolume4, BassVolume8,
+                TrebleVolume1, TrebleVolume2, TrebleVolume4, TrebleVolume8};
+        for (int i=0; i<8; i++) {
+            appendNumber(data, volumes[i]);
+        }
+    }
+
+    int tracks[2] = {bass_exp_track, treble_exp_track};
+    for (int t=0; t<2; t++) {
+        MidiEventList& events = midi_data[tracks[t]];
+        appendNumber(data, tracks[t]);
+        for (int i=0; i<events.getEventCount(); i++) {
+            if (!events[i].isNoteOn()) {
+                continue;
+            }
+            appendNumber(data, events[i].getKeyNumber());
+            appendNumber(data, events[i].seconds);
+            appendNumber(data, events[i].getDurationInSeconds());
+        }
+        appendNumber(data, -1);
+    }
+    check = RollCache::getCheck(data, roll_type);
+    return RollCache::getHash(data);
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::encodeExpression -- Return the expression curves of
+//    both hands in a compact binary form.  Each curve is stored as
+//    segments of a start value and a step added for each millisecond, so
+//    the valve states become intervals and the crescendos and decrescendos
+//    take one segment each.  The values are reproduced exactly.
+//
+
+std::string Expressionizer::encodeExpression(void) {
+    vector<double>* curves[14] = {
+        &exp_bass,   &isMF_bass,   &isSlowC_bass,   &isFastC_bass,
+        &isFastD_bass,   &step_bass,   &pressure_bass,
+        &exp_treble, &isMF_treble, &isSlowC_treble, &isFastC_treble,
+        &isFastD_treble, &step_treble, &pressure_treble
+    };
+    string data = "M2EC";
+    appendVariableLength(data, 1);    // format version
+    for (int c=0; c<14; c++) {
+        vector<double>& curve = *curves[c];
+        size_t size = curve.size();
+        appendVariableLength(data, size);
+        size_t i = 0;
+        while (i < size) {
+            double step = (i + 1 < size) ? curve[i+1] - curve[i] : 0.0;
+            double value = curve[i];
+            size_t count = 1;
+            while (i + count < size) {
+                double next = value + step;
+                if (memcmp(&next, &curve[i+count], sizeof(double)) != 0) {
+                    break;
+                }
+                value = next;
+                count++;
+            }
+            if (count == 1) {
+                step = 0.0;
+            }
+            appendVariableLength(data, count);
+            appendNumber(data, curve[i]);
+            appendNumber(data, step);
+            i += count;
+        }
     }
+    return data;
+}
+
 
+
+//////////////////////////////
+//
+// Expressionizer::decodeExpression -- Read the expression curves of both
+//    hands from the form made by encodeExpression().  Returns false if the
+//    data is not valid.
+//
+
+bool Expressionizer::decodeExpression(const std::string& data) {
+    vector<double>* curves[14] = {
+        &exp_bass,   &isMF_bass,   &isSlowC_bass,   &isFastC_bass,
+        &isFastD_bass,   &step_bass,   &pressure_bass,
+        &exp_treble, &isMF_treble, &isSlowC_treble, &isFastC_treble,
+        &isFastD_treble, &step_treble, &pressure_treble
+    };
+    size_t position = 4;
+    uint64_t version;
+    if ((data.compare(0, 4, "M2EC") != 0)
+            || !readVariableLength(data, position, version) || (version != 1)) {
+        return false;
+    }
+    for (int c=0; c<14; c++) {
+        vector<double>& curve = *curves[c];
+        uint64_t size;
+        if (!readVariableLength(data, position, size)
+                || (size > 0x7fffffff)) {
+            return false;
+        }
+        curve.clear();
+        curve.reserve(size);
+        while (curve.size() < size) {
+            uint64_t count;
+            double value;
+            double step;
+            if (!readVariableLength(data, position, count)
+                    || (count == 0) || (count > size - curve.size())
+                    || !readNumber(data, position, value)
+                    || !readNumber(data, position, step)) {
+                return false;
+            }
+            for (uint64_t i=0; i<count; i++) {
+                curve.push_back(value);
+                value += step;
+            }
+        }
+    }
+    return position == data.size();
 }
 
 
@@ -336,13 +665,13 @@ void Expressionizer::addSustainPedallingLockAndCancel(int sourcetrack, int onkey
 
     bool hascontroller = hasControllerInTrack(bass_track, pedal_controller);
     if (hascontroller) {
-        cerr << "Warning: Bass track already contains sustain pedalling." << endl;
+        getErrorStream() << "Warning: Bass track already contains sustain pedalling." << endl;
         return;
     }
 
     hascontroller = hasControllerInTrack(treble_track, pedal_controller);
     if (hascontroller) {
-        cerr << "Warning: Treble track already contains sustain pedalling." << endl;
+        getErrorStream() << "Warning: Treble track already contains sustain pedalling." << endl;
         return;
     }
 
@@ -426,13 +755,13 @@ void Expressionizer::addSoftPedallingLockAndCancel(int sourcetrack, int onkey, i
 
     bool hascontroller = hasControllerInTrack(bass_track, pedal_controller);
     if (hascontroller) {
-        cerr << "Warning: Bass track already contains soft pedalling." << endl;
+        getErrorStream() << "Warning: Bass track already contains soft pedalling." << endl;
         return;
     }
 
     hascontroller = hasControllerInTrack(treble_track, pedal_controller);
     if (hascontroller) {
-        cerr << "Warning: Treble track already contains soft pedalling." << endl;
+        getErrorStream() << "Warning: Treble track already contains soft pedalling." << endl;
         return;
     }
 
@@ -521,10 +850,11 @@ bool Expressionizer::hasControllerInTrack(int track, int controller) {
 // Expressionizer::setRollTempo -- Set the tempo of the roll
 // input: tempo  (slow: 67.25, regular: 104.331, fast: 143.373)
 // (old tempo: 98.4252 for red welte), (default 300 dpi, 6 as multiplier)
+// Changing the TPQ rescales the event times in place, and the note
+// links are unaffected, so the timing info does not need to be updated.
 //
 void Expressionizer::setRollTempo(double tempo) {
     midi_data.setTPQ(int(tempo * 6 + 0.5));
-    updateMidiTimingInfo();
 }
 
 
@@ -589,18 +919,67 @@ void Expressionizer::setPan(void) {
 
 //////////////////////////////
 //
-// Expressionizer::readMidiFile --
+// Expressionizer::readMidiFile -- Returns false if the file cannot be
+//    read or does not have the 5 tracks of a roll.
 //
 
 bool Expressionizer::readMidiFile(std::string filename) {
     bool status =  midi_data.read(filename);
-    if (midi_data.getTrackCount() != 5) {
-        cerr << "Error: expected 5 tracks, but found " << midi_data.getTrackCount() << endl;
-        exit(1);
+    if (!status) {
+        return status;
     }
+    return prepareInput();
+}
+
+//
+// istream version of Expressionizer::readMidiFile(), for rolls which are
+// already in memory.
+//
+
+bool Expressionizer::readMidiFile(std::istream& input) {
+    bool status =  midi_data.read(input);
     if (!status) {
         return status;
     }
+    return prepareInput();
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::copyInput -- Copy the roll which another Expressionizer
+//    has read (but not yet processed), so that several outputs can be
+//    made from one reading of the input with different settings.  The
+//    settings and the error stream of this object are kept.  Returns
+//    false if the source has no roll to copy.
+//
+
+bool Expressionizer::copyInput(const Expressionizer& source) {
+    if (source.midi_data.getTrackCount() != 5) {
+        getErrorStream() << "Error: no roll to copy" << endl;
+        return false;
+    }
+    std::ostream& errors = midi_data.getErrorStream();
+    reset();
+    midi_data = source.midi_data;
+    midi_data.setErrorStream(&errors);
+    return true;
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::prepareInput -- Check that the roll which was just read
+//    has 5 tracks, and analyze its timing.
+//
+
+bool Expressionizer::prepareInput(void) {
+    if (midi_data.getTrackCount() != 5) {
+        getErrorStream() << "Error: expected 5 tracks, but found " << midi_data.getTrackCount() << endl;
+        return false;
+    }
     updateMidiTimingInfo();
     return true;
 }
@@ -614,7 +993,11 @@ bool Expressionizer::readMidiFile(std::string filename) {
 
 void Expressionizer::updateMidiTimingInfo(void) {
     midi_data.doTimeAnalysis();
-    midi_data.linkNotePairs();
+    for (int i=0; i<midi_data.getTrackCount(); i++) {
+        // only the note durations are needed on the expression tracks
+        bool exptrack = (i == bass_exp_track) || (i == treble_exp_track);
+        midi_data[i].linkNotePairs(exptrack);
+    }
 }
 
 
@@ -625,6 +1008,28 @@ void Expressionizer::updateMidiTimingInfo(void) {
 //
 
 bool Expressionizer::writeMidiFile(std::string filename) {
+    prepareOutput();
+    return midi_data.write(filename);
+}
+
+//
+// ostream version of Expressionizer::writeMidiFile().
+//
+
+bool Expressionizer::writeMidiFile(std::ostream& output) {
+    prepareOutput();
+    return midi_data.write(output);
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::prepareOutput -- Remove the expression tracks if
+//    requested, add the metadata and sort the tracks before writing.
+//
+
+void Expressionizer::prepareOutput(void) {
     if ((midi_data.getTrackCount() == 5) && delete_expression_tracks) {
         midi_data.deleteTrack(4);
         midi_data.deleteTrack(3);
@@ -633,7 +1038,9 @@ bool Expressionizer::writeMidiFile(std::string filename) {
     addMetadata();
 
     midi_data.sortTracks();
-    return midi_data.write(filename);
+    if (remove_redundant_events) {
+        midi_data.removeRedundantEvents(redundant_report);
+    }
 }
 
 
@@ -648,70 +1055,82 @@ void Expressionizer::addMetadata(void) {
     midi_data.setMetadata("EXP_SOFTWARE", "\t\thttps://github.com/pianoroll/midi2exp");
 
     stringstream ss;
-    ss << "@EXP_SOFTWARE_DATE:\t" << __DATE__ << " " << __TIME__   << "";
+    ss << "@EXP_SOFTWARE_DATE:\t" << getSoftwareDate()   << "";
     string sss = ss.str();
     sss = ss.str();
     sss.erase(remove(sss.begin(), sss.end(), '\n'), sss.end());
     midi_data.addText(0, 0, sss);
 
     ss.str("");
-    std::chrono::system_clock::time_point nowtime = std::chrono::system_clock::now();
-    std::time_t current_time = std::chrono::system_clock::to_time_t(nowtime);
-    ss << "@EXP_DATE:\t\t"     << std::ctime(&current_time);
+    if (!m_date.empty()) {
+        ss << "@EXP_DATE:\t\t" << m_date;
+    } else {
+        std::chrono::system_clock::time_point nowtime = std::chrono::system_clock::now();
+        std::time_t current_time = std::chrono::system_clock::to_time_t(nowtime);
+        // ctime() uses a shared buffer, and rolls may be processed in threads.
+        static std::mutex ctimeMutex;
+        std::lock_guard<std::mutex> lock(ctimeMutex);
+        ss << "@EXP_DATE:\t\t"     << std::ctime(&current_time);
+    }
     sss = ss.str();
     sss.erase(remove(sss.begin(), sss.end(), '\n'), sss.end());
     midi_data.addText(0, 0, sss);
 
+    // set the remaining metadata together so that track 0 is sorted once
+    vector<pair<string, string>> entries;
+
     if (!m_version.empty()) {
-        midi_data.setMetadata("VERSION", m_version);
+        entries.emplace_back("VERSION", m_version);
     }
 
     ss.str("");
     ss << "\t\t" << m_accelFtPerMin2;
     sss = ss.str();
-    midi_data.setMetadata("ACCEL_FT/MIN^2", sss);
+    entries.emplace_back("ACCEL_FT/MIN^2", sss);
 
     if (trackbar_correction_done) {
         int correction = int(getTrackerbarDiameter() * getPunchExtensionFraction() + 0.5);
         string value = "\t" + to_string(correction) + "px";
-        midi_data.setMetadata("TRACKER_EXTENSION", value);
+        entries.emplace_back("TRACKER_EXTENSION", value);
     } else {
-        midi_data.setMetadata("TRACKER_EXTENSION", "\t0px");
+        entries.emplace_back("TRACKER_EXTENSION", "\t0px");
     }
 
     ss.str("");
     ss << "\t\t" << getWelteP();
-    midi_data.setMetadata("EXP_WELTE_P", ss.str());
+    entries.emplace_back("EXP_WELTE_P", ss.str());
 
     ss.str("");
     ss << "\t\t" << getWelteMF();
-    midi_data.setMetadata("EXP_WELTE_MF", ss.str());
+    entries.emplace_back("EXP_WELTE_MF", ss.str());
 
     ss.str("");
     ss << "\t\t" << getWelteF();
-    midi_data.setMetadata("EXP_WELTE_F", ss.str());
+    entries.emplace_back("EXP_WELTE_F", ss.str());
 
     ss.str("");
     ss << "\t" << getWelteLoud();
-    midi_data.setMetadata("EXP_WELTE_LOUD", ss.str());
+    entries.emplace_back("EXP_WELTE_LOUD", ss.str());
 
     ss.str("");
     ss << "\t" << getLeftRightDiff();
-    midi_data.setMetadata("LEFT_HAND_ADJUST", ss.str());
+    entries.emplace_back("LEFT_HAND_ADJUST", ss.str());
 
     ss.str("");
     ss << "\t" << getSlowDecayRate() << " ms (time from welte_p to welte_mf)";
-    midi_data.setMetadata("EXP_WELTE_SLOW_DECAY", ss.str());
+    entries.emplace_back("EXP_WELTE_SLOW_DECAY", ss.str());
 
     ss.str("");
     ss << "\t" << getFastCrescendo() << " ms (time from welte_p to welte_mf)";
-    midi_data.setMetadata("EXP_WELTE_FAST_CRES", ss.str());
+    entries.emplace_back("EXP_WELTE_FAST_CRES", ss.str());
 
     ss.str("");
     ss << "\t" << getFastDecrescendo() << " ms (time from welte_p to welte_f)";
-    midi_data.setMetadata("EXP_WELTE_FAST_DECRS", ss.str());
+    entries.emplace_back("EXP_WELTE_FAST_DECRS", ss.str());
 
-    midi_data.setMetadata("MIDIFILE_TYPE", "\texp");
+    entries.emplace_back("MIDIFILE_TYPE", "\texp");
+
+    midi_data.setMetadata(entries);
 
 }
 
@@ -778,6 +1197,46 @@ void Expressionizer::setVersion(std::string version) {
     m_version = version;
 }
 
+
+
+//////////////////////////////
+//
+// Expressionizer::setDate -- Set the date written in the @EXP_DATE
+//    metadata instead of the current time, so that converting the same
+//    roll again gives an identical file.  An empty string goes back to
+//    the current time.  (@EXP_SOFTWARE_DATE is the build time of the
+//    program, which compilers take from SOURCE_DATE_EPOCH if it is set.)
+//
+
+void Expressionizer::setDate(const std::string& date) {
+    m_date = date;
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::getSoftwareDate -- Return the build time of the
+//    expression engine, as written in the @EXP_SOFTWARE_DATE metadata.
+//
+
+std::string Expressionizer::getSoftwareDate(void) {
+    return __DATE__ " " __TIME__;
+}
+
+
+
+//////////////////////////////
+//
+// Expressionizer::getEngineVersion -- Return the version of the output of
+//    the expression engine, for the keys of the caches.  Unlike the build
+//    time, it only changes when the output does.
+//
+
+int Expressionizer::getEngineVersion(void) {
+    return EngineVersion;
+}
+
 //////////////////////////////
 //
 // Expressionizer::getPreviousNonzero -- Get the previous nonzero value
@@ -836,7 +1295,7 @@ int Expressionizer::step2pressure(int stepval,const std::string& option){
         } else if (stepval == 15){
             return 27;
         } else{
-            cerr << "step value not within 0-15" << endl;
+            getErrorStream() << "step value not within 0-15" << endl;
         }
     }
     else {
@@ -873,7 +1332,7 @@ int Expressionizer::step2pressure(int stepval,const std::string& option){
         } else if (stepval == 15){
             return 33;
         } else{
-            cerr << "step value not within 0-15" << endl;
+            getErrorStream() << "step value not within 0-15" << endl;
         }
     }
     return 0;
@@ -1867,26 +2326,18 @@ ostream& Expressionizer::printExpression(ostream& out, bool extended) {
 
 bool Expressionizer::applyTrackBarWidthCorrection(void) {
     if (midi_data.getTrackCount() < 2) {
-        cerr << "Error: no MIDI data to correct" << endl;
+        getErrorStream() << "Error: no MIDI data to correct" << endl;
         return false;
     }
     if (trackbar_correction_done) {
-        cerr << "Error: you already did the correction, so not doing it again." << endl;
+        getErrorStream() << "Error: you already did the correction, so not doing it again." << endl;
         return false;
     }
 
+    // The note-offs are moved in place: the note links do not change,
+    // and only the times of the moved events are recalculated.
     int correction = int(getTrackerbarDiameter() * getPunchExtensionFraction() + 0.5);
-    for (int i=0; i<midi_data.getTrackCount(); i++) {
-        for (int j=0; j<midi_data[i].getEventCount(); j++) {
-            if (!midi_data[i][j].isNoteOff()) {
-                continue;
-            }
-            midi_data[i][j].tick += correction;
-        }
-    }
-
-    midi_data.sortTracks();
-    updateMidiTimingInfo();
+    midi_data.shiftNoteOffs(correction);
     trackbar_correction_done = true;
     return true;
 }
@@ -1964,6 +2415,21 @@ void Expressionizer::removeExpressionTracksOnWrite(void) {
 
 
 
+///////////////////////////////
+//
+// Expressionizer::removeRedundantEventsOnWrite -- Remove controller,
+//   patch change and tempo messages which do not change the state of
+//   their channel before writing (see MidiRoll::removeRedundantEvents()).
+//   The removed messages are listed in the report stream if one is given.
+//
+
+void Expressionizer::removeRedundantEventsOnWrite(std::ostream* report) {
+    remove_redundant_events = true;
+    redundant_report = report;
+}
+
+
+
 ///////////////////////////////
 //
 // Expressionizer::setPianoTimbre -- Add a piano patch change
@@ -1987,7 +2453,7 @@ bool Expressionizer::setPianoTimbre(void) {
     }
 
     if (midi_data.getTrackCount() < 3) {
-        cerr << "Error: not enough tracks in MIDI file: " << midi_data.getTrackCount() << endl;
+        getErrorStream() << "Error: not enough tracks in MIDI file: " << midi_data.getTrackCount() << endl;
         return false;
     }
 
@@ -2110,4 +2576,98 @@ double Expressionizer::getWelteLoud(void)       { return welte_loud; }
 double Expressionizer::getSlowDecayRate(void)   { return slow_decay_rate;  }
 double Expressionizer::getFastCrescendo(void)   { return fastC_decay_rate; }
 double Expressionizer::getFastDecrescendo(void) { return fastD_decay_rate; }
-double Expressionizer::getLeftRightDiff(void)   { return left_adjust; }
\ No newline at end of file
+double Expressionizer::getLeftRightDiff(void)   { return left_adjust; }
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// Static functions:
+//
+
+
+//////////////////////////////
+//
+// appendNumber -- Append the bytes of a number to a string in
+//    little-endian order, which is the same on all systems.
+//
+
+static void appendNumber(std::string& data, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i=0; i<8; i++) {
+        data += (char)((bits >> (8 * i)) & 0xff);
+    }
+}
+
+
+static void appendNumber(std::string& data, int value) {
+    uint32_t bits = (uint32_t)value;
+    for (int i=0; i<4; i++) {
+        data += (char)((bits >> (8 * i)) & 0xff);
+    }
+}
+
+
+
+//////////////////////////////
+//
+// readNumber -- Read a double written by appendNumber().  Returns false
+//    if there are not enough bytes left.
+//
+
+static bool readNumber(const std::string& data, size_t& position, double& value) {
+    if (data.size() - position < 8) {
+        return false;
+    }
+    uint64_t bits = 0;
+    for (int i=7; i>=0; i--) {
+        bits = (bits << 8) | (unsigned char)data[position + i];
+    }
+    memcpy(&value, &bits, sizeof(value));
+    position += 8;
+    return true;
+}
+
+
+
+//////////////////////////////
+//
+// appendVariableLength -- Append a number in 7-bit groups, lowest group
+//    first, with the top bit set on all but the last byte.
+//
+
+static void appendVariableLength(std::string& data, uint64_t value) {
+    while (value >= 0x80) {
+        data += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    data += (char)value;
+}
+
+
+
+//////////////////////////////
+//
+// readVariableLength -- Read a number written by appendVariableLength().
+//    Returns false if the data ends first.
+//
+
+static bool readVariableLength(const std::string& data, size_t& position,
+        uint64_t& value) {
+    value = 0;
+    for (int shift=0; shift<64; shift+=7) {
+        if (position >= data.size()) {
+            return false;
+        }
+        unsigned char byte = data[position++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
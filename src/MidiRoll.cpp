@@ -12,9 +12,9 @@
 
 #include "MidiRoll.h"
 
+#include <cmath>
 #include <iostream>
 #include <vector>
-#include <regex>
 #include <string>
 
 
@@ -29,8 +29,23 @@ MidiRoll::MidiRoll(void) : MidiFile() { }
 MidiRoll::MidiRoll(const char* aFile) : MidiFile(aFile) { }
 MidiRoll::MidiRoll(const std::string& aFile) : MidiFile(aFile) { }
 MidiRoll::MidiRoll(std::istream& input) : MidiFile(input) { }
-MidiRoll::MidiRoll(const MidiRoll& other) : MidiFile(other) { }
-MidiRoll::MidiRoll(MidiRoll&& other) : MidiFile(other) { }
+MidiRoll::MidiRoll(const MidiRoll& other) : MidiFile(other) {
+	m_lengthdpi      = other.m_lengthdpi;
+	m_widthdpi       = other.m_widthdpi;
+	m_metadatamarker = other.m_metadatamarker;
+	m_accelerationQ  = other.m_accelerationQ;
+	m_accelFtPerMin2 = other.m_accelFtPerMin2;
+	m_accelMaxError  = other.m_accelMaxError;
+}
+
+MidiRoll::MidiRoll(MidiRoll&& other) : MidiFile(other) {
+	m_lengthdpi      = other.m_lengthdpi;
+	m_widthdpi       = other.m_widthdpi;
+	m_metadatamarker = other.m_metadatamarker;
+	m_accelerationQ  = other.m_accelerationQ;
+	m_accelFtPerMin2 = other.m_accelFtPerMin2;
+	m_accelMaxError  = other.m_accelMaxError;
+}
 
 
 
@@ -53,16 +68,89 @@ MidiRoll& MidiRoll::operator=(const MidiRoll& other) {
 		return *this;
 	}
 	MidiFile::operator=(other);
+	m_lengthdpi      = other.m_lengthdpi;
+	m_widthdpi       = other.m_widthdpi;
+	m_metadatamarker = other.m_metadatamarker;
+	m_accelerationQ  = other.m_accelerationQ;
+	m_accelFtPerMin2 = other.m_accelFtPerMin2;
+	m_accelMaxError  = other.m_accelMaxError;
+	m_metadataevents = -1;
 	return *this;
 }
 
 MidiRoll& MidiRoll::operator=(const MidiFile& other) {
 	MidiFile::operator=(other);
+	m_accelerationQ  = false;
+	m_accelFtPerMin2 = 0.0;
+	m_metadataevents = -1;
 	return *this;
 }
 
 
 
+//////////////////////////////
+//
+// MidiRoll::read -- Read a MIDI file into the roll.
+//
+
+bool MidiRoll::read(std::istream& instream) {
+	m_metadataevents = -1;
+	return MidiFile::read(instream);
+}
+
+
+
+
+//////////////////////////////
+//
+// MidiRoll::scan -- Read only the header and the text meta messages in
+//    the first track of a MIDI file, which is enough to access the roll
+//    metadata (see MidiFile::scan()).
+//
+
+bool MidiRoll::scan(std::istream& instream) {
+	m_metadataevents = -1;
+	return MidiFile::scan(instream);
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::recycle -- Remove the roll contents and turn off the
+//    acceleration model, keeping the allocated memory for the next roll
+//    (see MidiFile::recycle()).
+//
+
+void MidiRoll::recycle(void) {
+	m_metadataindex.clear();
+	m_metadataevents = -1;
+	m_accelerationQ  = false;
+	m_accelFtPerMin2 = 0.0;
+	MidiFile::recycle();
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::write -- Write the roll as a standard MIDI file.  If the
+//    acceleration model is active, the first track is written with
+//    tempo messages emulating it in place of its own tempo messages.
+//    The roll itself is not changed.
+//
+
+bool MidiRoll::write(std::ostream& out) {
+	if (!m_accelerationQ) {
+		return MidiFile::write(out);
+	}
+	MidiEventList firsttrack;
+	makeAccelerationTrack(firsttrack);
+	return writeFile(out, &firsttrack);
+}
+
+
+
 //////////////////////////////
 //
 // MidiRoll::setRollTempo -- Set the piano-roll tempo of the MIDI file.
@@ -85,15 +173,15 @@ void MidiRoll::setRollTempo(double tempo, double dpi) {
 	int tpq = int(tempo/10.0 * dpi*12.0/60.0 + 0.5);
 	if (tpq < 1) {
 		// SMPTE ticks or error: do not alter
-		std::cerr << "Error: tpq is too small: " << tpq << std::endl;
+		getErrorStream() << "Error: tpq is too small: " << tpq << std::endl;
 		return;
 	}
 	if (tpq > 0x7FFF) {
 		// SMPTE ticks: do not alter
-		std::cerr << "Error: tpq is too large: " << tpq << std::endl;
+		getErrorStream() << "Error: tpq is too large: " << tpq << std::endl;
 		return;
 	}
-	MidiFile::setTicksPerQuarterNote(tpq);
+	setTicksPerQuarterNote(tpq);
 }
 
 
@@ -184,28 +272,57 @@ std::vector<MidiEvent*> MidiRoll::getMetadataEvents(void) {
 
 std::string MidiRoll::getMetadata(const std::string& key) {
 	std::string output;
-	std::string query;
-	query += getMetadataMarker();
-	query += key;
-	query += ":\\s*(.*)\\s*$";
-	std::regex re(query);
-	std::smatch match;
-	MidiRoll& mr = *this;
-	for (int i=0; i<mr[0].size(); i++) {
-		if (!mr[0][i].isText()) {
+	int index = getMetadataIndex(key);
+	if (index < 0) {
+		return output;
+	}
+	std::string content = operator[](0)[index].getMetaContent();
+	size_t start = getMetadataMarker().size() + key.size() + 1;
+	size_t end = content.size();
+	while ((start < end) && isspace(content[start])) {
+		start++;
+	}
+	while ((end > start) && isspace(content[end-1])) {
+		end--;
+	}
+	output = content.substr(start, end - start);
+	return output;
+}
+
+
+
+//
+// Get a list of all metadata key/value pairs in the first track, in the
+// order in which they occur (only the first occurrence of a key is used).
+//
+
+void MidiRoll::getMetadata(std::vector<std::pair<std::string,
+		std::string>>& entries) {
+	entries.clear();
+	if (getTrackCount() < 1) {
+		return;
+	}
+	MidiEventList& track = operator[](0);
+	if (m_metadataevents != track.size()) {
+		buildMetadataIndex();
+	}
+	for (int i=0; i<track.size(); i++) {
+		if (!track[i].isText()) {
 			continue;
 		}
-		std::string content = mr[0][i].getMetaContent();
-		try {
-			if (std::regex_search(content, match, re) && (match.size() > 1)) {
-				output = match.str(1);
-				break;
-			}
-		} catch (std::regex_error& e) {
-			std::cerr << "PROBLEM SEARCHING FOR METADATA" << std::endl;
+		std::string content = track[i].getMetaContent();
+		size_t colon = content.find(':', m_metadatamarker.size());
+		if (colon == std::string::npos) {
+			continue;
+		}
+		std::string key = content.substr(m_metadatamarker.size(),
+				colon - m_metadatamarker.size());
+		auto it = m_metadataindex.find(key);
+		if ((it == m_metadataindex.end()) || (it->second != i)) {
+			continue;
 		}
+		entries.emplace_back(key, getMetadata(key));
 	}
-	return output;
 }
 
 
@@ -213,66 +330,199 @@ std::string MidiRoll::getMetadata(const std::string& key) {
 //////////////////////////////
 //
 // MidiRoll::setMetadata -- Change the value of a given metadata key.
-//    If there is no key for that metadata value, the add it.
+//    If there is no key for that metadata value, the add it.  Returns
+//    the tick of the changed metadata line (0 if it was added), or -1 if
+//    the key is empty.
+//
+//    The second form changes or adds a list of metadata key/value pairs
+//    at once.  New lines are added in the order given, and the first
+//    track is only sorted once.  Returns the number of entries set, or
+//    -1 if any key is empty (the other entries are still set).
 //
 
 int MidiRoll::setMetadata(const std::string& key, const std::string& value) {
 	if (key.empty()) {
-		std::cerr << "KEY CANNOT BE EMPTY" << std::endl;
+		getErrorStream() << "KEY CANNOT BE EMPTY" << std::endl;
 		return -1;
 	}
-	bool found = false;
 	int output = 0;
-	std::string query;
-	query += getMetadataMarker();
-	query += key;
-	query += ":\\s*(.*)\\s*$";
-	std::regex re(query);
-	std::smatch match;
-	MidiRoll& mr = *this;
-	for (int i=0; i<mr[0].size(); i++) {
-		if (!mr[0][i].isText()) {
+	if (updateMetadata(key, value, output)) {
+		return output;
+	}
+	addText(0, 0, makeMetadataLine(key, value, true));
+	sortTrack(0);
+	m_metadataevents = -1;
+	return output;
+}
+
+
+int MidiRoll::setMetadata(const std::vector<std::pair<std::string,
+		std::string>>& entries) {
+	int output = 0;
+	int tick;
+	bool added = false;
+	bool error = false;
+	for (int i=0; i<(int)entries.size(); i++) {
+		const std::string& key = entries[i].first;
+		if (key.empty()) {
+			getErrorStream() << "KEY CANNOT BE EMPTY" << std::endl;
+			error = true;
 			continue;
 		}
-		std::string content = mr[0][i].getMetaContent();
-		try {
-			if (std::regex_search(content, match, re) && (match.size() > 1)) {
-				std::string newline;
-				newline += getMetadataMarker();
-				newline += key;
-				newline += ":";
-            if ((!value.empty()) && (!isspace(value[0]))) {
-            } else {
-               newline += " ";
-            }
-				newline += value;
-				mr[0][i].setMetaContent(newline);
-				found = true;
-				output = mr[0][i].tick;
-				break;
-			}
-		} catch (std::regex_error& e) {
-			std::cerr << "PROBLEM SEARCHING FOR METADATA" << std::endl;
+		if (!updateMetadata(key, entries[i].second, tick)) {
+			// Add the new line without sorting: index entries stay valid
+			// since the line is appended to the end of the track.
+			addText(0, 0, makeMetadataLine(key, entries[i].second, true));
+			m_metadataindex.emplace(key, operator[](0).size() - 1);
+			m_metadataevents = operator[](0).size();
+			added = true;
 		}
+		output++;
 	}
-	if (found) {
-		return output;
+	if (added) {
+		sortTrack(0);
+		m_metadataevents = -1;
 	}
+	return error ? -1 : output;
+}
 
-	std::string newline;
-	newline += getMetadataMarker();
-	newline += key;
-	newline += ": ";
-	newline += value;
 
-	mr.addText(0, 0, newline);
-	mr.sortTrack(0);
 
+//////////////////////////////
+//
+// MidiRoll::updateMetadata -- Change the value of an existing metadata
+//    line.  Returns false if the key is not found.  The tick of the line
+//    is stored in the tick parameter.
+//
+
+bool MidiRoll::updateMetadata(const std::string& key,
+		const std::string& value, int& tick) {
+	int index = getMetadataIndex(key);
+	if (index < 0) {
+		return false;
+	}
+	MidiEvent& event = operator[](0)[index];
+	event.setMetaContent(makeMetadataLine(key, value, false));
+	tick = event.tick;
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::makeMetadataLine -- Return the text of a metadata line.
+//    When changing an existing line, the space after the colon is only
+//    added if the value is empty or starts with whitespace.
+//
+
+std::string MidiRoll::makeMetadataLine(const std::string& key,
+		const std::string& value, bool newline) {
+	std::string output;
+	output += getMetadataMarker();
+	output += key;
+	output += ":";
+	if (newline || value.empty() || isspace(value[0])) {
+		output += " ";
+	}
+	output += value;
 	return output;
 }
 
 
 
+//////////////////////////////
+//
+// MidiRoll::getMetadataIndex -- Return the index in the first track of
+//    the first metadata line for the given key, or -1 if there is none.
+//    The index of metadata keys is rebuilt when the number of events in
+//    the first track changes, or when an index entry no longer matches
+//    its key (such as after sorting the track).
+//
+
+int MidiRoll::getMetadataIndex(const std::string& key) {
+	if (getTrackCount() < 1) {
+		return -1;
+	}
+	MidiEventList& track = operator[](0);
+	if (m_metadataevents != track.size()) {
+		buildMetadataIndex();
+	}
+	auto it = m_metadataindex.find(key);
+	if (it == m_metadataindex.end()) {
+		return -1;
+	}
+	if ((it->second < track.size()) && isMetadataLine(track[it->second], key)) {
+		return it->second;
+	}
+	buildMetadataIndex();
+	it = m_metadataindex.find(key);
+	if (it == m_metadataindex.end()) {
+		return -1;
+	}
+	return it->second;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::buildMetadataIndex -- Store the index of the first line for
+//    each metadata key in the first track.  A metadata line is a text
+//    meta message which starts with the metadata marker, followed by the
+//    key and a colon.
+//
+
+void MidiRoll::buildMetadataIndex(void) {
+	m_metadataindex.clear();
+	MidiEventList& track = operator[](0);
+	const std::string& marker = m_metadatamarker;
+	for (int i=0; i<track.size(); i++) {
+		if (!track[i].isText()) {
+			continue;
+		}
+		std::string content = track[i].getMetaContent();
+		if (content.compare(0, marker.size(), marker) != 0) {
+			continue;
+		}
+		size_t colon = content.find(':', marker.size());
+		if ((colon == std::string::npos) || (colon == marker.size())) {
+			continue;
+		}
+		m_metadataindex.emplace(content.substr(marker.size(),
+				colon - marker.size()), i);
+	}
+	m_metadataevents = track.size();
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::isMetadataLine -- Returns true if the event is a metadata
+//    line for the given key.
+//
+
+bool MidiRoll::isMetadataLine(MidiEvent& event, const std::string& key) {
+	if (!event.isText()) {
+		return false;
+	}
+	std::string content = event.getMetaContent();
+	const std::string& marker = m_metadatamarker;
+	if (content.size() <= marker.size() + key.size()) {
+		return false;
+	}
+	if (content.compare(0, marker.size(), marker) != 0) {
+		return false;
+	}
+	if (content.compare(marker.size(), key.size(), key) != 0) {
+		return false;
+	}
+	return content[marker.size() + key.size()] == ':';
+}
+
+
+
 //////////////////////////////
 //
 // MidiRoll::trackerize -- Emulate tracker bar extension
@@ -282,23 +532,211 @@ int MidiRoll::setMetadata(const std::string& key, const std::string& value) {
 void MidiRoll::trackerize(int trackerheight) {
 	MidiRoll& mr = *this;
 
-	mr.joinTracks();   // make a single list of events
 	mr.linkNotePairs();
 
-	for (int i=0; i<mr[0].getSize(); i++) {
-		if (!mr[0][i].isNoteOn()) {
-			continue;
+	for (int i=0; i<mr.getTrackCount(); i++) {
+		for (int j=0; j<mr[i].getSize(); j++) {
+			if (mr[i][j].isNoteOn() && !mr[i][j].isLinked()) {
+				getErrorStream() << "MISSING NOTE OFF" << std::endl;
+			}
 		}
-		MidiEvent* me = mr[0][i].getLinkedEvent();
-		if (!me) {
-			std::cerr << "MISSING NOTE OFF" << std::endl;
-			continue;
+	}
+
+	// only note-offs which end a hole are extended:
+	mr.shiftNoteOffs(trackerheight, true);
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::shiftNoteOffs -- Move note-offs by the given number of ticks
+//     (see MidiFile::shiftNoteOffs()), with the times in seconds of the
+//     moved events calculated from the acceleration model if it is active.
+//
+
+void MidiRoll::shiftNoteOffs(int ticks, bool linkedonly) {
+	MidiFile::shiftNoteOffs(ticks, linkedonly);
+	if (!(m_accelerationQ && m_timemapvalid)) {
+		return;
+	}
+	MidiRoll& mr = *this;
+	for (int i=0; i<mr.getTrackCount(); i++) {
+		for (int j=0; j<mr[i].getEventCount(); j++) {
+			if (!mr[i][j].isNoteOff()) {
+				continue;
+			}
+			if (linkedonly && !mr[i][j].isLinked()) {
+				continue;
+			}
+			mr[i][j].seconds = getTimeInSeconds(mr[i][j].tick);
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::removeRedundantEvents -- Remove controller, patch change and
+//     tempo messages which do not change the current state of their
+//     channel (or of the tempo), such as a sustain pedal off when the
+//     pedal is already off.  All tracks are walked together in tick
+//     order since tracks can share a channel.  Messages of the same kind
+//     at the same tick with different values are all kept, since their
+//     order is not defined, and the next message of that kind is then
+//     kept as well.  Controllers which are not states (data entry,
+//     RPN/NRPN and channel mode messages) are not removed.  If a report
+//     stream is given, a line is printed for each removed message with
+//     the tick, track, channel, message type and value.  Returns the
+//     number of messages removed.
+//
+
+int MidiRoll::removeRedundantEvents(std::ostream* report) {
+	MidiRoll& mr = *this;
+	int oldTimeState = getTickState();
+	if (oldTimeState == TIME_STATE_DELTA) {
+		makeAbsoluteTicks();
+	}
+	sortTracks();
+
+	// values: -1 = unknown state, -2 = not at current tick, -3 = conflict
+	const int keycount = 16 * 128 + 16 + 1;
+	std::vector<int> state(keycount, -1);
+	std::vector<int> tickvalue(keycount, -2);
+	std::vector<int> touched;
+	std::vector<MidiEvent*> group;
+	std::vector<int> groupkeys;
+	std::vector<int> groupvalues;
+	std::vector<int> grouptracks;
+	std::vector<int> index(mr.getTrackCount(), 0);
+	int removed = 0;
+
+	while (true) {
+		// collect the state messages at the next tick in all tracks:
+		int tick = -1;
+		for (int i=0; i<mr.getTrackCount(); i++) {
+			if (index[i] < mr[i].getEventCount()) {
+				int t = mr[i][index[i]].tick;
+				if ((tick < 0) || (t < tick)) {
+					tick = t;
+				}
+			}
+		}
+		if (tick < 0) {
+			break;
+		}
+		group.clear();
+		groupkeys.clear();
+		groupvalues.clear();
+		grouptracks.clear();
+		for (int i=0; i<mr.getTrackCount(); i++) {
+			while ((index[i] < mr[i].getEventCount()) && (mr[i][index[i]].tick == tick)) {
+				MidiEvent& event = mr[i][index[i]++];
+				int value;
+				int key = getStateKey(event, value);
+				if (key < 0) {
+					continue;
+				}
+				group.push_back(&event);
+				groupkeys.push_back(key);
+				groupvalues.push_back(value);
+				grouptracks.push_back(i);
+				if (tickvalue[key] == -2) {
+					tickvalue[key] = value;
+					touched.push_back(key);
+				} else if (tickvalue[key] != value) {
+					tickvalue[key] = -3;
+				}
+				if ((key < 16 * 128) && ((key % 128 == 0) || (key % 128 == 32))) {
+					// bank select: the next patch change is not redundant
+					state[16 * 128 + key / 128] = -1;
+				}
+			}
+		}
+
+		for (int i=0; i<(int)group.size(); i++) {
+			int key = groupkeys[i];
+			if (tickvalue[key] == -3) {
+				continue;
+			}
+			if (state[key] != groupvalues[i]) {
+				state[key] = groupvalues[i];
+				continue;
+			}
+			if (report) {
+				MidiEvent& event = *group[i];
+				*report << tick << "\t" << grouptracks[i] << "\t";
+				if (event.isTempo()) {
+					*report << "-\ttempo";
+				} else if (event.isPatchChange()) {
+					*report << event.getChannel() << "\tpatch";
+				} else {
+					*report << event.getChannel() << "\tcontroller " << event.getP1();
+				}
+				*report << "\t" << groupvalues[i] << "\n";
+			}
+			group[i]->unlinkEvent();
+			group[i]->clear();
+			removed++;
+		}
+
+		for (int i=0; i<(int)touched.size(); i++) {
+			if (tickvalue[touched[i]] == -3) {
+				state[touched[i]] = -1;
+			}
+			tickvalue[touched[i]] = -2;
 		}
-		me->tick += trackerheight;
+		touched.clear();
 	}
 
-	mr.splitTracks(); // split events into separate tracks again
-	mr.sortTracks();  // necessary since timestamps have been changed
+	if (removed) {
+		MidiFile::removeEmpties();
+	}
+	if (oldTimeState == TIME_STATE_DELTA) {
+		makeDeltaTicks();
+	}
+	return removed;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::getStateKey -- Return an index for the kind of state which
+//     the message sets, and store the new state in value: 0-2047 for
+//     controllers (channel * 128 + controller number), 2048-2063 for
+//     patch changes and 2064 for tempo.  Returns -1 for other messages.
+//
+
+int MidiRoll::getStateKey(MidiEvent& event, int& value) {
+	if (event.isTempo()) {
+		value = event.getTempoMicroseconds();
+		return 16 * 128 + 16;
+	}
+	if (event.size() < 2) {
+		return -1;
+	}
+	if (event.isPatchChange()) {
+		value = event.getP1();
+		return 16 * 128 + event.getChannel();
+	}
+	if (!event.isController() || (event.size() < 3)) {
+		return -1;
+	}
+	int controller = event.getP1();
+	switch (controller) {
+		case 6:  case 38:                     // data entry
+		case 96: case 97:                     // data increment/decrement
+		case 98: case 99: case 100: case 101: // NRPN/RPN numbers
+			return -1;
+	}
+	if (controller >= 120) {
+		// channel mode messages
+		return -1;
+	}
+	value = event.getP2();
+	return event.getChannel() * 128 + controller;
 }
 
 
@@ -307,10 +745,217 @@ void MidiRoll::trackerize(int trackerheight) {
 //
 // MidiRoll::removeAcceleration -- Remove any tempo meta messages
 //    which are intended to emulate roll acceleration on the pickup
-//    spool of a player piano.
+//    spool of a player piano, and turn off the acceleration model.
 //
 
 void MidiRoll::removeAcceleration (void) {
+	m_accelerationQ  = false;
+	m_accelFtPerMin2 = 0.0;
+	setConstantTempo();
+	m_timemapvalid = 0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::applyAcceleration -- Emulate roll acceleration according
+//    to the input parameter.  The timing of the roll is calculated
+//    from a constant-acceleration model of the take-up spool rather
+//    than from tempo messages: a roll moving at a starting speed of
+//    v0 feet/minute with acceleration a feet/minute^2 has travelled
+//    x = v0*t + a*t^2/2 feet after t minutes.  Tempo messages which
+//    approximate the model are only added when the file is written.
+//    The maxError parameter is the largest difference in seconds
+//    allowed between the model and the times given by the written tempo
+//    messages at any point in the roll.
+// default values:
+//      accelFtPerMin2 = 0.2;
+//      maxError       = 0.001;
+//
+
+void MidiRoll::applyAcceleration(double accelFtPerMin2, double maxError) {
+	removeAcceleration();  // adds one tempo=60.0 message at tick 0
+	if (accelFtPerMin2 < 0.0) {
+		return;
+	}
+	m_accelerationQ  = true;
+	m_accelFtPerMin2 = accelFtPerMin2;
+	if (maxError > 0.0) {
+		m_accelMaxError = maxError;
+	}
+	doTimeAnalysis();
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::hasAcceleration -- Returns true if the acceleration model
+//    is being used for the timing of the roll.
+//
+
+bool MidiRoll::hasAcceleration(void) const {
+	return m_accelerationQ;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::getAcceleration -- Return the roll acceleration in feet
+//    per minute^2 (0.0 if the acceleration model is not active).
+//
+
+double MidiRoll::getAcceleration(void) const {
+	return m_accelFtPerMin2;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::getAccelerationMaxError -- Return the maximum timing error
+//    in seconds for tempo messages written to emulate acceleration.
+//
+
+double MidiRoll::getAccelerationMaxError(void) const {
+	return m_accelMaxError;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::doTimeAnalysis -- Calculate the time in seconds for each
+//    event.  When the acceleration model is active, the times are
+//    calculated from the exact solution of the model, solving
+//    x = v0*t + a*t^2/2 for t (in the form t = 2x / (v0 + sqrt(v0^2 + 2ax))
+//    which is stable when a is zero or small).
+//
+
+void MidiRoll::doTimeAnalysis(void) {
+	MidiFile::doTimeAnalysis();
+	if (!m_accelerationQ) {
+		return;
+	}
+	stampAccelerationTimes();
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::setTicksPerQuarterNote -- Change the roll tempo without
+//    redoing the time analysis.  Without acceleration the event times
+//    are rescaled linearly (see MidiFile::setTicksPerQuarterNote).
+//    The acceleration model does not scale linearly with the starting
+//    speed of the roll, so in that case the event times are recalculated
+//    from the model.  Note links are not affected by a tempo change.
+//
+
+void MidiRoll::setTicksPerQuarterNote(int ticks) {
+	MidiFile::setTicksPerQuarterNote(ticks);
+	if (m_accelerationQ && m_timemapvalid) {
+		stampAccelerationTimes();
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::stampAccelerationTimes -- Set the time in seconds of every
+//    event from the acceleration model.
+//
+
+void MidiRoll::stampAccelerationTimes(void) {
+	MidiRoll& mr = *this;
+	for (int i=0; i<mr.getTrackCount(); i++) {
+		for (int j=0; j<mr[i].getEventCount(); j++) {
+			mr[i][j].seconds = getTimeInSeconds(mr[i][j].tick);
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::getTimeInSeconds -- Return the time in seconds of a tick
+//    position on the roll.  Returns -1.0 for negative ticks.
+//
+
+double MidiRoll::getTimeInSeconds(int tickvalue) {
+	if (!m_accelerationQ) {
+		return MidiFile::getTimeInSeconds(tickvalue);
+	}
+	if (tickvalue < 0) {
+		return -1.0;
+	}
+	double feet  = tickvalue / (getLengthDpi() * 12.0);
+	double speed = getStartSpeed();
+	double minutes = 2.0 * feet / (speed + sqrt(speed * speed
+			+ 2.0 * m_accelFtPerMin2 * feet));
+	return minutes * 60.0;
+}
+
+
+void MidiRoll::getTimeInSeconds(const std::vector<int>& ticks,
+		std::vector<double>& output) {
+	if (!m_accelerationQ) {
+		MidiFile::getTimeInSeconds(ticks, output);
+		return;
+	}
+	output.resize(ticks.size());
+	for (int i=0; i<(int)ticks.size(); i++) {
+		output[i] = getTimeInSeconds(ticks[i]);
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::getAbsoluteTickTime -- Return the tick position on the roll
+//    at the given time in seconds.  Returns -1.0 for negative times.
+//
+
+double MidiRoll::getAbsoluteTickTime(double starttime) {
+	if (!m_accelerationQ) {
+		return MidiFile::getAbsoluteTickTime(starttime);
+	}
+	if (starttime < 0.0) {
+		return -1.0;
+	}
+	double minutes = starttime / 60.0;
+	double feet = getStartSpeed() * minutes
+			+ m_accelFtPerMin2 * minutes * minutes / 2.0;
+	return feet * getLengthDpi() * 12.0;
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::getStartSpeed -- Return the speed of the roll at its start
+//    in feet per minute.  The roll tempo is given by the ticks-per-quarter
+//    value with a reference tempo of 60 bpm (see setRollTempo()).
+//
+
+double MidiRoll::getStartSpeed(void) {
+	return getTPQ() * 60.0 / (getLengthDpi() * 12.0);
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::removeTempoMessages -- Remove all tempo meta messages from
+//    the first track.
+//
+
+void MidiRoll::removeTempoMessages(void) {
 	MidiRoll& mr = *this;
 	for (int i=0; i<mr[0].size(); i++) {
 		if (!mr[0][i].isTempo()) {
@@ -319,6 +964,18 @@ void MidiRoll::removeAcceleration (void) {
 		mr[0][i].clear();
 	}
 	MidiFile::removeEmpties();
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::setConstantTempo -- Remove all tempo meta messages from
+//    the first track and replace them with tempo = 60 at tick 0.
+//
+
+void MidiRoll::setConstantTempo(void) {
+	removeTempoMessages();
 	// Need to add tempo = 60 at tick 0
 	MidiFile::addTempo(0, 0, 60.0);
 	MidiFile::sortTrack(0);
@@ -328,29 +985,138 @@ void MidiRoll::removeAcceleration (void) {
 
 //////////////////////////////
 //
-// MidiRoll::applyAcceleration -- Emulate roll acceleration according
-//    to the input parameter.
-// default value:
-//      accelFtPerMin2 = 0.2;
+// MidiRoll::makeAccelerationTrack -- Store a copy of the first track
+//    in which the tempo messages are replaced by ones that emulate the
+//    acceleration model.  The roll is divided greedily into the longest
+//    constant-tempo segments for which the written timing stays within
+//    m_accelMaxError seconds of the model, so the fewest tempo messages
+//    are used for the given tolerance.  The error is tracked from the
+//    (integer microsecond) tempos that are actually written, so it does
+//    not accumulate along the roll.
 //
 
-void MidiRoll::applyAcceleration(double accelFtPerMin2) {
-	removeAcceleration();  // adds one tempo=60.0 message at tick 0
+void MidiRoll::makeAccelerationTrack(MidiEventList& track) {
+	const MidiFile& mf = *this;
+	track.clear();
+	for (int i=0; i<mf[0].getEventCount(); i++) {
+		if (mf[0][i].isTempo() || mf[0][i].empty()) {
+			continue;
+		}
+		MidiEvent event = mf[0][i];
+		track.push_back(event);
+	}
+	MidiEvent tempo;
+	tempo.makeTempo(60.0);
+	int    maxtick   = getMaxTick();
+	if (maxtick <= 0) {
+		tempo.tick = 0;
+		track.push_back(tempo);
+		sortEvents(track);
+		return;
+	}
+	int    starttick = 0;
+	double startsec  = 0.0;
+	int    lastmicro = -1;
+	int    micro;
+	while (true) {
+		// find the longest segment which fits in the error bounds by
+		// doubling its length and then bisecting:
+		int good = starttick + 1;
+		int bad  = -1;
+		int length = 2;
+		while (bad < 0) {
+			int endtick = starttick + length;
+			if (endtick >= maxtick) {
+				if (fitsAccelerationTempo(starttick, startsec, maxtick, micro)) {
+					good = maxtick;
+				} else {
+					bad = maxtick;
+				}
+				break;
+			}
+			if (fitsAccelerationTempo(starttick, startsec, endtick, micro)) {
+				good = endtick;
+				length *= 2;
+			} else {
+				bad = endtick;
+			}
+		}
+		while ((bad > 0) && (bad - good > 1)) {
+			int endtick = good + (bad - good) / 2;
+			if (fitsAccelerationTempo(starttick, startsec, endtick, micro)) {
+				good = endtick;
+			} else {
+				bad = endtick;
+			}
+		}
+		fitsAccelerationTempo(starttick, startsec, good, micro);
+		if (micro != lastmicro) {
+			tempo.tick = starttick;
+			tempo.setTempoMicroseconds(micro);
+			track.push_back(tempo);
+			lastmicro = micro;
+		}
+		startsec += (good - starttick) * (micro / 1000000.0) / getTPQ();
+		starttick = good;
+		if (starttick >= maxtick) {
+			break;
+		}
+	}
+	sortEvents(track);
+}
+
+
+
+//////////////////////////////
+//
+// MidiRoll::fitsAccelerationTempo -- Returns true if a single tempo
+//    starting at starttick (where the written time is startseconds) can
+//    reach endtick while staying within the maximum error of the
+//    acceleration model.  The tempo (in microseconds per quarter note)
+//    is returned in the micro parameter; it is aimed at the model time
+//    at endtick.  Since the model time is concave in ticks, the error
+//    of a constant tempo is largest at the ends of the segment or where
+//    the model speed matches the tempo, so only those points are checked.
+//
+
+bool MidiRoll::fitsAccelerationTempo(int starttick, double startseconds,
+		int endtick, int& micro) {
+	int    tpq        = getTPQ();
 	double ticksPerFt = getLengthDpi() * 12.0;
-	double tempo      = 60.0;
-	double minutediv  = .1; // how often the tempo is updated, could be param
-	double startspeed = (getTPQ() * tempo) / ticksPerFt;
-	double speed      = startspeed;
-	double minute     = 0.0;
-	int    tick       = 0;
-	while (tick < getMaxTick()) {
-		addTempo(0, tick, tempo);
-		minute += minutediv;
-		tick += (int)(speed * minutediv * ticksPerFt);
-		speed = startspeed + minute * accelFtPerMin2;
-		tempo = speed * ticksPerFt / getTPQ();
+	double endseconds = getTimeInSeconds(endtick);
+	double spt        = (endseconds - startseconds) / (endtick - starttick);
+	micro = (int)(spt * tpq * 1000000.0 + 0.5);
+	if (micro < 1) {
+		micro = 1;
+	} else if (micro > 0xffffff) {
+		micro = 0xffffff;
 	}
-	sortTrack(0);
+	spt = micro / 1000000.0 / tpq;
+
+	double error = startseconds - getTimeInSeconds(starttick);
+	if (fabs(error) > m_accelMaxError) {
+		return false;
+	}
+	error = startseconds + (endtick - starttick) * spt - endseconds;
+	if (fabs(error) > m_accelMaxError) {
+		return false;
+	}
+	if (m_accelFtPerMin2 > 0.0) {
+		// tick position where the model speed is equal to the tempo:
+		double speed = 60.0 / (spt * ticksPerFt);
+		double startspeed = getStartSpeed();
+		double feet = (speed * speed - startspeed * startspeed)
+				/ (2.0 * m_accelFtPerMin2);
+		double tick = feet * ticksPerFt;
+		if ((tick > starttick) && (tick < endtick)) {
+			double minutes = (speed - startspeed) / m_accelFtPerMin2;
+			error = startseconds + (tick - starttick) * spt - minutes * 60.0;
+			if (fabs(error) > m_accelMaxError) {
+				return false;
+			}
+		}
+	}
+	return true;
 }
 
 
@@ -446,6 +1212,7 @@ std::string MidiRoll::getMetadataMarker(void) {
 
 void MidiRoll::setMetadataMarker(const std::string& value) {
 	m_metadatamarker = value;
+	m_metadataevents = -1;
 }
 
 
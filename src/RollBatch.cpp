@@ -0,0 +1,393 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/src/RollBatch.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   List of rolls to convert in batch mode.
+//
+
+#include "RollBatch.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+	#include <dirent.h>
+#endif
+
+using namespace std;
+
+
+
+//////////////////////////////
+//
+// RollBatch::readManifest -- Add the rolls listed in a manifest file to
+//     the list of rolls to convert.  Blank lines and lines starting with
+//     "#" are ignored.  If a line has no output file, the output is the
+//     input filename in the output directory.
+//
+
+bool RollBatch::readManifest(const string& filename, const string& outdir,
+		const RollSettings& defaults, ostream& errors) {
+	ifstream input(filename);
+	if (!input.is_open()) {
+		errors << "Error: cannot read " << filename << endl;
+		return false;
+	}
+	string line;
+	int linenum = 0;
+	while (getline(input, line)) {
+		linenum++;
+		if (!line.empty() && (line.back() == '\r')) {
+			line.pop_back();
+		}
+		size_t start = line.find_first_not_of(" \t");
+		if ((start == string::npos) || (line[start] == '#')) {
+			continue;
+		}
+
+		vector<pair<string, string>> fields;
+		RollJob job;
+		job.settings = defaults;
+		if (line[start] == '{') {
+			if (!parseJsonLine(line.substr(start), fields)) {
+				errors << "Error: invalid JSON on line " << linenum << " of " << filename << endl;
+				return false;
+			}
+		} else {
+			vector<string> columns;
+			size_t pos = 0;
+			while (true) {
+				size_t tab = line.find('\t', pos);
+				columns.push_back(line.substr(pos, tab == string::npos ? string::npos : tab - pos));
+				if (tab == string::npos) {
+					break;
+				}
+				pos = tab + 1;
+			}
+			fields.emplace_back("input", columns[0]);
+			if ((columns.size() > 1) && (columns[1].find('=') == string::npos)) {
+				fields.emplace_back("output", columns[1]);
+			}
+			for (int i=1; i<(int)columns.size(); i++) {
+				size_t equals = columns[i].find('=');
+				if (equals != string::npos) {
+					fields.emplace_back(columns[i].substr(0, equals), columns[i].substr(equals + 1));
+				}
+			}
+		}
+
+		for (int i=0; i<(int)fields.size(); i++) {
+			if (fields[i].first == "input") {
+				job.input = fields[i].second;
+			} else if (fields[i].first == "output") {
+				job.output = fields[i].second;
+			} else if (!job.settings.setOverride(fields[i].first, fields[i].second)) {
+				errors << "Error: invalid setting " << fields[i].first << "=" << fields[i].second
+				       << " on line " << linenum << " of " << filename << endl;
+				return false;
+			}
+		}
+		if (job.input.empty()) {
+			errors << "Error: no input file on line " << linenum << " of " << filename << endl;
+			return false;
+		}
+		if (job.output.empty()) {
+			if (outdir.empty()) {
+				errors << "Error: no output file on line " << linenum << " of " << filename
+				       << " and no output directory (-o)" << endl;
+				return false;
+			}
+			job.output = getOutputName(job.input, outdir);
+		}
+		m_jobs.push_back(job);
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollBatch::readDirectory -- Add each MIDI file in a directory (in
+//     filename order) to the list of rolls to convert, with the output
+//     files written to outdir under the same names.
+//
+
+bool RollBatch::readDirectory(const string& dirname, const string& outdir,
+		const RollSettings& defaults, ostream& errors) {
+#ifdef _WIN32
+	errors << "Error: directory input is not supported on Windows; use a manifest" << endl;
+	return false;
+#else
+	string indir = dirname;
+	string outpath = outdir;
+	while ((indir.size() > 1) && (indir.back() == '/')) indir.pop_back();
+	while ((outpath.size() > 1) && (outpath.back() == '/')) outpath.pop_back();
+	if (indir == outpath) {
+		errors << "Error: the output directory must differ from the input directory" << endl;
+		return false;
+	}
+	DIR* dir = opendir(dirname.c_str());
+	if (!dir) {
+		errors << "Error: cannot read directory " << dirname << endl;
+		return false;
+	}
+	vector<string> names;
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		string name = entry->d_name;
+		if (name.size() < 5) {
+			continue;
+		}
+		string extension = name.substr(name.size() - 4);
+		transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (extension == ".mid") {
+			names.push_back(name);
+		}
+	}
+	closedir(dir);
+	sort(names.begin(), names.end());
+	for (int i=0; i<(int)names.size(); i++) {
+		RollJob job;
+		job.input = indir + "/" + names[i];
+		job.output = getOutputName(job.input, outdir);
+		job.settings = defaults;
+		m_jobs.push_back(job);
+	}
+	return true;
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollBatch::convert -- Convert all of the rolls on threadcount threads.
+//     Each roll has its own Expressionizer, so the output files do not
+//     depend on the order in which the rolls are converted.  The status,
+//     time, errors and (if reportQ is true) the removed redundant messages
+//     of each roll are stored in its job.
+//
+
+void RollBatch::convert(int threadcount, RollCache* cache, bool reportQ) {
+	// start the largest rolls first, so that the last ones to finish are short.
+	vector<int> order(m_jobs.size());
+	for (int i=0; i<(int)m_jobs.size(); i++) {
+		order[i] = i;
+		ifstream input(m_jobs[i].input, ios::binary | ios::ate);
+		m_jobs[i].size = input.is_open() ? (long)input.tellg() : -1;
+	}
+	stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return m_jobs[a].size > m_jobs[b].size;
+	});
+
+	atomic<int> next(0);
+	auto worker = [&]() {
+		int index;
+		while ((index = next++) < (int)order.size()) {
+			RollJob& job = m_jobs[order[index]];
+			auto start = chrono::steady_clock::now();
+			stringstream jobreport;
+			stringstream joberrors;
+			job.status = job.settings.convertRoll(job.input, job.output, NULL,
+					reportQ ? &jobreport : NULL, joberrors, cache);
+			job.report = jobreport.str();
+			job.errors = joberrors.str();
+			job.seconds = chrono::duration<double>(chrono::steady_clock::now()
+					- start).count();
+		}
+	};
+
+	threadcount = max(1, min(threadcount, (int)m_jobs.size()));
+	vector<thread> threads;
+	for (int i=1; i<threadcount; i++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (int i=0; i<(int)threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+
+
+//////////////////////////////
+//
+// RollBatch::getJobs -- Return the rolls in the order in which they were
+//     read.
+//
+
+vector<RollJob>& RollBatch::getJobs(void) {
+	return m_jobs;
+}
+
+
+
+//////////////////////////////
+//
+// RollBatch::isDirectory -- Return true if the path is a directory which
+//     can be read.
+//
+
+bool RollBatch::isDirectory(const string& path) {
+#ifdef _WIN32
+	return false;
+#else
+	DIR* dir = opendir(path.c_str());
+	if (!dir) {
+		return false;
+	}
+	closedir(dir);
+	return true;
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollBatch::parseJsonLine -- Read the fields of a single-line JSON
+//     object with string, number or boolean values.  Returns false if the
+//     line is not such an object.
+//
+
+bool RollBatch::parseJsonLine(const string& line,
+		vector<pair<string, string>>& fields) {
+	size_t pos = 0;
+	auto skipSpace = [&]() {
+		while ((pos < line.size()) && isspace((unsigned char)line[pos])) {
+			pos++;
+		}
+	};
+	auto readString = [&](string& output) {
+		output.clear();
+		if ((pos >= line.size()) || (line[pos] != '"')) {
+			return false;
+		}
+		pos++;
+		while (pos < line.size()) {
+			char ch = line[pos++];
+			if (ch == '"') {
+				return true;
+			}
+			if (ch != '\\') {
+				output += ch;
+				continue;
+			}
+			if (pos >= line.size()) {
+				return false;
+			}
+			ch = line[pos++];
+			switch (ch) {
+				case 'n': output += '\n'; break;
+				case 't': output += '\t'; break;
+				case 'r': output += '\r'; break;
+				case 'b': output += '\b'; break;
+				case 'f': output += '\f'; break;
+				case 'u':
+					{
+						if (pos + 4 > line.size()) {
+							return false;
+						}
+						int code = (int)strtol(line.substr(pos, 4).c_str(), NULL, 16);
+						pos += 4;
+						if (code < 0x80) {
+							output += (char)code;
+						} else if (code < 0x800) {
+							output += (char)(0xc0 | (code >> 6));
+							output += (char)(0x80 | (code & 0x3f));
+						} else {
+							output += (char)(0xe0 | (code >> 12));
+							output += (char)(0x80 | ((code >> 6) & 0x3f));
+							output += (char)(0x80 | (code & 0x3f));
+						}
+					}
+					break;
+				default: output += ch;
+			}
+		}
+		return false;
+	};
+
+	fields.clear();
+	skipSpace();
+	if ((pos >= line.size()) || (line[pos] != '{')) {
+		return false;
+	}
+	pos++;
+	skipSpace();
+	if ((pos < line.size()) && (line[pos] == '}')) {
+		return true;
+	}
+	while (true) {
+		string key;
+		string value;
+		skipSpace();
+		if (!readString(key)) {
+			return false;
+		}
+		skipSpace();
+		if ((pos >= line.size()) || (line[pos] != ':')) {
+			return false;
+		}
+		pos++;
+		skipSpace();
+		if ((pos < line.size()) && (line[pos] == '"')) {
+			if (!readString(value)) {
+				return false;
+			}
+		} else {
+			size_t end = line.find_first_of(",} \t", pos);
+			if (end == string::npos) {
+				return false;
+			}
+			value = line.substr(pos, end - pos);
+			pos = end;
+			if (value.empty()) {
+				return false;
+			}
+		}
+		fields.emplace_back(key, value);
+		skipSpace();
+		if (pos >= line.size()) {
+			return false;
+		}
+		if (line[pos] == '}') {
+			return true;
+		}
+		if (line[pos] != ',') {
+			return false;
+		}
+		pos++;
+	}
+}
+
+
+
+//////////////////////////////
+//
+// RollBatch::getOutputName -- Return the name of the input file (without
+//     its directory) in the output directory.
+//
+
+string RollBatch::getOutputName(const string& input, const string& outdir) {
+	size_t slash = input.find_last_of("/\\");
+	string name = slash == string::npos ? input : input.substr(slash + 1);
+	if (outdir.empty()) {
+		return name;
+	}
+	if ((outdir.back() == '/') || (outdir.back() == '\\')) {
+		return outdir + name;
+	}
+	return outdir + "/" + name;
+}
@@ -0,0 +1,572 @@
+//
+// Creation Date: Sun Oct 18 21:40:27 PDT 2026
+// Last Modified: Sun Oct 18 21:40:27 PDT 2026
+// Filename:      midi2exp/src/RollCache.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   On-disk cache of converted rolls.
+//
+
+#include "RollCache.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+	#include <dirent.h>
+	#include <sys/stat.h>
+	#include <sys/types.h>
+	#include <unistd.h>
+	#include <utime.h>
+#endif
+
+using namespace std;
+
+static void sha256(const string& data, unsigned char digest[32]);
+
+// extension of the cache entry files
+static const char* EntryExtension = ".m2e";
+
+// start of the header line of each entry (followed by the check)
+static const char* EntryHeader = "m2e-cache 1\t";
+
+
+
+//////////////////////////////
+//
+// RollCache::RollCache -- Constructor.  The cache is not used until a
+//     directory is given.
+//
+
+RollCache::RollCache(void) : m_hits(0), m_misses(0), m_stores(0),
+		m_evictions(0) {
+	// do nothing
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::~RollCache -- Deconstructor.
+//
+
+RollCache::~RollCache() {
+	// do nothing
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::setDirectory -- Set the directory of the cache, which is
+//     created if it does not exist.  Returns false if it cannot be used,
+//     with a message printed to the error stream.
+//
+
+bool RollCache::setDirectory(const string& directory) {
+#ifdef _WIN32
+	getErrorStream() << "Error: the roll cache is not supported on Windows" << endl;
+	return false;
+#else
+	string path = directory;
+	while ((path.size() > 1) && (path.back() == '/')) {
+		path.pop_back();
+	}
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		if (mkdir(path.c_str(), 0777) != 0) {
+			getErrorStream() << "Error: cannot create cache directory " << path << endl;
+			return false;
+		}
+	} else if (!S_ISDIR(info.st_mode)) {
+		getErrorStream() << "Error: cache " << path << " is not a directory" << endl;
+		return false;
+	}
+	m_directory = path;
+	return true;
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getDirectory -- Return the directory of the cache (empty if
+//     there is none).
+//
+
+const string& RollCache::getDirectory(void) const {
+	return m_directory;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::setMaxSize -- Set the total size of the entries (in bytes)
+//     above which evict() removes the least recently used entries.
+//     Default value is 1 GB.
+//
+
+void RollCache::setMaxSize(long long bytes) {
+	m_maxsize = bytes < 0 ? 0 : bytes;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getMaxSize -- Return the maximum size of the cache in bytes.
+//
+
+long long RollCache::getMaxSize(void) const {
+	return m_maxsize;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::keepInMemory -- Keep the entries in memory, such as for
+//     sharing results between the objects of one program.  Stored entries
+//     are still written to the directory if there is one, and a lookup
+//     checks memory before the directory.  Default value is true.
+//
+
+void RollCache::keepInMemory(bool state) {
+	m_memoryQ = state;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::isActive -- Returns true if the cache has a directory or
+//     keeps its entries in memory.
+//
+
+bool RollCache::isActive(void) const {
+	return m_memoryQ || !m_directory.empty();
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::setErrorStream -- Set the stream where error messages are
+//     printed (std::cerr by default).  Use NULL to discard them.
+//
+
+void RollCache::setErrorStream(ostream* out) {
+	m_errorstream = out;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getErrorStream -- Return the stream for error messages.  A
+//     stream which discards everything is returned if the messages are
+//     turned off.
+//
+
+ostream& RollCache::getErrorStream(void) const {
+	static thread_local ostream nullstream(NULL);
+	if (m_errorstream == NULL) {
+		return nullstream;
+	}
+	return *m_errorstream;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getHash -- Return the SHA-256 hash of the data as 64
+//     hexadecimal digits.  Different data cannot be made to give the same
+//     hash, so entries are safe for rolls sent by the clients of a server.
+//
+
+string RollCache::getHash(const string& data) {
+	unsigned char digest[32];
+	sha256(data, digest);
+	static const char* hexdigits = "0123456789abcdef";
+	string output(64, '0');
+	for (int i=0; i<32; i++) {
+		output[2 * i]     = hexdigits[digest[i] >> 4];
+		output[2 * i + 1] = hexdigits[digest[i] & 0x0f];
+	}
+	return output;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getKey -- Return the key of a cache entry for an input
+//     MIDI file and a description of all of the settings which change
+//     the output (including the version of the program).
+//
+
+string RollCache::getKey(const string& input, const string& settings) {
+	string data;
+	data.reserve(settings.size() + input.size() + 16);
+	data += to_string(settings.size());
+	data += '\n';
+	data += settings;
+	data += input;
+	return getHash(data);
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getCheck -- Return the check stored with an entry for an
+//     input MIDI file and a description of the settings (see getKey()):
+//     the length of the input and a hash of the settings.
+//
+
+string RollCache::getCheck(const string& input, const string& settings) {
+	return to_string(input.size()) + "\t" + getHash(settings);
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::lookup -- Read the output stored for the key.  Returns false
+//     if there is no entry for it, or if the entry was stored with a
+//     different check (see getCheck()).  A found entry is marked as
+//     recently used.
+//
+
+bool RollCache::lookup(const string& key, const string& check,
+		string& output) {
+	if (!isActive()) {
+		return false;
+	}
+	string header = getEntryHeader(check);
+	if (m_memoryQ) {
+		lock_guard<mutex> guard(m_entrymutex);
+		auto entry = m_entries.find(key);
+		if ((entry != m_entries.end())
+				&& (entry->second.compare(0, header.size(), header) == 0)) {
+			output.assign(entry->second, header.size(), string::npos);
+			m_hits++;
+			return true;
+		}
+	}
+	if (m_directory.empty()) {
+		m_misses++;
+		return false;
+	}
+	string filename = getEntryName(key);
+	ifstream input(filename, ios::binary | ios::ate);
+	if (!input.is_open()) {
+		m_misses++;
+		return false;
+	}
+	streamoff size = input.tellg();
+	if ((size < (streamoff)header.size()) || !input.seekg(0, ios::beg)) {
+		m_misses++;
+		return false;
+	}
+	output.resize((size_t)size);
+	if (!input.read(&output[0], size)
+			|| (output.compare(0, header.size(), header) != 0)) {
+		m_misses++;
+		output.clear();
+		return false;
+	}
+	output.erase(0, header.size());
+#ifndef _WIN32
+	// the modification time is used to find the least recently used entries.
+	utime(filename.c_str(), NULL);
+#endif
+	m_hits++;
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::store -- Store the output for the key.  The entry is written
+//     to a temporary file which is then renamed, so other threads or
+//     programs never read an incomplete entry.  Returns false if the entry
+//     cannot be written.
+//
+
+bool RollCache::store(const string& key, const string& check,
+		const string& output) {
+	if (!isActive()) {
+		return false;
+	}
+	string header = getEntryHeader(check);
+	if (m_memoryQ) {
+		lock_guard<mutex> guard(m_entrymutex);
+		m_entries[key] = header + output;
+	}
+	if (m_directory.empty()) {
+		m_stores++;
+		return true;
+	}
+	string filename = getEntryName(key);
+	stringstream temporary;
+	temporary << filename << ".tmp" << hash<thread::id>()(this_thread::get_id());
+#ifndef _WIN32
+	temporary << "." << getpid();
+#endif
+	ofstream out(temporary.str(), ios::binary);
+	if (!out.is_open()) {
+		return false;
+	}
+	out.write(header.data(), header.size());
+	out.write(output.data(), output.size());
+	out.close();
+	if (!out || (rename(temporary.str().c_str(), filename.c_str()) != 0)) {
+		remove(temporary.str().c_str());
+		return false;
+	}
+	m_stores++;
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::evict -- Remove the least recently used entries until the
+//     cache is no larger than its maximum size.  Returns the number of
+//     entries removed.
+//
+
+int RollCache::evict(void) {
+#ifdef _WIN32
+	return 0;
+#else
+	if (m_directory.empty()) {
+		return 0;
+	}
+	DIR* dir = opendir(m_directory.c_str());
+	if (!dir) {
+		return 0;
+	}
+	// (modification time, size, filename) of each entry
+	vector<pair<pair<time_t, long long>, string>> entries;
+	long long total = 0;
+	string extension = EntryExtension;
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		string name = entry->d_name;
+		if ((name.size() <= extension.size())
+				|| (name.compare(name.size() - extension.size(), string::npos, extension) != 0)) {
+			continue;
+		}
+		string filename = m_directory + "/" + name;
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0) {
+			continue;
+		}
+		entries.push_back(make_pair(make_pair(info.st_mtime, (long long)info.st_size), filename));
+		total += info.st_size;
+	}
+	closedir(dir);
+
+	if (total <= m_maxsize) {
+		return 0;
+	}
+	sort(entries.begin(), entries.end());
+	int count = 0;
+	for (int i=0; (i<(int)entries.size()) && (total > m_maxsize); i++) {
+		if (remove(entries[i].second.c_str()) == 0) {
+			total -= entries[i].first.second;
+			count++;
+		}
+	}
+	m_evictions += count;
+	return count;
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getHits -- Return the number of lookups which found an entry.
+//
+
+long RollCache::getHits(void) const {
+	return m_hits;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getMisses -- Return the number of lookups which did not find
+//     an entry.
+//
+
+long RollCache::getMisses(void) const {
+	return m_misses;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getStores -- Return the number of entries stored.
+//
+
+long RollCache::getStores(void) const {
+	return m_stores;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getEvictions -- Return the number of entries removed by
+//     evict().
+//
+
+long RollCache::getEvictions(void) const {
+	return m_evictions;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::printStatistics -- Print the numbers of hits, misses,
+//     stored entries and evicted entries on one line (without a newline).
+//
+
+ostream& RollCache::printStatistics(ostream& out) const {
+	long lookups = getHits() + getMisses();
+	out << getHits() << " hits, " << getMisses() << " misses";
+	if (lookups > 0) {
+		out << " (" << (100.0 * getHits() / lookups) << "% hits)";
+	}
+	out << ", " << getStores() << " stored, " << getEvictions() << " evicted";
+	return out;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getEntryName -- Return the filename of the entry for a key.
+//
+
+string RollCache::getEntryName(const string& key) const {
+	return m_directory + "/" + key + EntryExtension;
+}
+
+
+
+//////////////////////////////
+//
+// RollCache::getEntryHeader -- Return the line at the start of an entry
+//     for a check.
+//
+
+string RollCache::getEntryHeader(const string& check) {
+	return EntryHeader + check + "\n";
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// Static functions:
+//
+
+
+//////////////////////////////
+//
+// sha256 -- Calculate the SHA-256 hash of the data (FIPS 180-4).
+//
+
+static void sha256(const string& data, unsigned char digest[32]) {
+	static const uint32_t k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+		0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+		0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+		0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+		0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+		0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+		0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+		0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+		0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+	uint32_t h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	auto rotate = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+	// the last blocks: the rest of the data, a 1 bit, zeros and the length in bits
+	size_t length = data.size();
+	size_t full = length / 64 * 64;
+	unsigned char tail[128] = {0};
+	size_t tailsize = length - full;
+	memcpy(tail, data.data() + full, tailsize);
+	tail[tailsize] = 0x80;
+	size_t tailblocks = (tailsize + 9 <= 64) ? 64 : 128;
+	uint64_t bits = (uint64_t)length * 8;
+	for (int i=0; i<8; i++) {
+		tail[tailblocks - 1 - i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	const unsigned char* bytes = (const unsigned char*)data.data();
+	uint32_t w[64];
+	for (size_t offset=0; offset<full+tailblocks; offset+=64) {
+		const unsigned char* block = offset < full ? bytes + offset : tail + (offset - full);
+		for (int i=0; i<16; i++) {
+			w[i] = ((uint32_t)block[4*i] << 24) | ((uint32_t)block[4*i+1] << 16)
+					| ((uint32_t)block[4*i+2] << 8) | (uint32_t)block[4*i+3];
+		}
+		for (int i=16; i<64; i++) {
+			uint32_t s0 = rotate(w[i-15], 7) ^ rotate(w[i-15], 18) ^ (w[i-15] >> 3);
+			uint32_t s1 = rotate(w[i-2], 17) ^ rotate(w[i-2], 19) ^ (w[i-2] >> 10);
+			w[i] = w[i-16] + s0 + w[i-7] + s1;
+		}
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+		uint32_t e = h[4], f = h[5], g = h[6], x = h[7];
+		for (int i=0; i<64; i++) {
+			uint32_t s1 = rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25);
+			uint32_t t1 = x + s1 + ((e & f) ^ (~e & g)) + k[i] + w[i];
+			uint32_t s0 = rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22);
+			uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+			x = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += x;
+	}
+
+	for (int i=0; i<8; i++) {
+		digest[4*i]   = (unsigned char)(h[i] >> 24);
+		digest[4*i+1] = (unsigned char)(h[i] >> 16);
+		digest[4*i+2] = (unsigned char)(h[i] >> 8);
+		digest[4*i+3] = (unsigned char)h[i];
+	}
+}
+
+
+
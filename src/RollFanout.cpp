@@ -0,0 +1,181 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/src/RollFanout.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Several output variants of one input roll.
+//
+
+#include "RollFanout.h"
+#include "Expressionizer.h"
+#include "RollCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+
+
+//////////////////////////////
+//
+// RollFanout::readVariants -- Read the list of outputs to make from one
+//     input file.  Each line is an output file and key=value overrides.
+//     Blank lines and lines starting with "#" are ignored.
+//
+
+bool RollFanout::readVariants(const string& filename, const string& input,
+		const RollSettings& defaults, ostream& errors) {
+	m_input = input;
+	ifstream file(filename);
+	if (!file.is_open()) {
+		errors << "Error: cannot read " << filename << endl;
+		return false;
+	}
+	string line;
+	int linenum = 0;
+	while (getline(file, line)) {
+		linenum++;
+		istringstream fields(line);
+		RollJob job;
+		if (!(fields >> job.output) || (job.output[0] == '#')) {
+			continue;
+		}
+		if (job.output.find('=') != string::npos) {
+			errors << "Error: no output file on line " << linenum << " of " << filename << endl;
+			return false;
+		}
+		string params;
+		getline(fields, params);
+		job.input = input;
+		job.settings = defaults;
+		stringstream message;
+		if (!job.settings.setOverrides(params, message)) {
+			errors << message.str().substr(0, message.str().size() - 1) << " on line "
+			       << linenum << " of " << filename << endl;
+			return false;
+		}
+		m_jobs.push_back(job);
+	}
+	if (m_jobs.empty()) {
+		errors << "Error: no variants in " << filename << endl;
+		return false;
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollFanout::convert -- Convert the input file with the settings of
+//     each variant.  The input is read and analyzed once and copied for
+//     each variant.  The expression curves are shared in memory (and kept
+//     in the expression cache if there is one), and the first variant of
+//     each set with the same expression settings is done first so that the
+//     others can use its curves.  The variants in each of these two rounds
+//     are run on threadcount threads.
+//
+
+void RollFanout::convert(int threadcount, RollCache* expressionCache) {
+	auto start = chrono::steady_clock::now();
+	stringstream readerrors;
+	Expressionizer base;
+	base.setErrorStream(&readerrors);
+	bool status = base.readMidiFile(m_input);
+	if (!status) {
+		readerrors << "Error: cannot read " << m_input << endl;
+	}
+	double readseconds = chrono::duration<double>(chrono::steady_clock::now()
+			- start).count();
+	for (int i=0; i<(int)m_jobs.size(); i++) {
+		m_jobs[i].status = false;
+		m_jobs[i].seconds = readseconds;
+	}
+	// warnings from reading the input are only given once
+	m_jobs[0].errors = readerrors.str();
+	if (!status) {
+		return;
+	}
+
+	RollCache curves;
+	curves.keepInMemory();
+	if (expressionCache) {
+		curves.setDirectory(expressionCache->getDirectory());
+		curves.setMaxSize(expressionCache->getMaxSize());
+	}
+
+	vector<int> first;
+	vector<int> rest;
+	vector<string> keys;
+	for (int i=0; i<(int)m_jobs.size(); i++) {
+		string key = m_jobs[i].settings.getCurveKey();
+		if (find(keys.begin(), keys.end(), key) == keys.end()) {
+			keys.push_back(key);
+			first.push_back(i);
+		} else {
+			rest.push_back(i);
+		}
+	}
+
+	auto convertJob = [&](RollJob& job) {
+		auto jobstart = chrono::steady_clock::now();
+		stringstream errors;
+		stringstream output;
+		Expressionizer creator;
+		creator.setErrorStream(&errors);
+		job.settings.setupRoll(creator, NULL);
+		creator.setExpressionCache(&curves);
+		job.status = creator.copyInput(base)
+				&& job.settings.expressRoll(creator, NULL, NULL)
+				&& creator.writeMidiFile(output)
+				&& RollSettings::writeOutputFile(job.output, output.str(), errors);
+		job.errors += errors.str();
+		job.seconds += chrono::duration<double>(chrono::steady_clock::now()
+				- jobstart).count();
+	};
+
+	vector<int>* rounds[2] = {&first, &rest};
+	for (int r=0; r<2; r++) {
+		vector<int>& indexes = *rounds[r];
+		atomic<int> next(0);
+		auto worker = [&]() {
+			int index;
+			while ((index = next++) < (int)indexes.size()) {
+				convertJob(m_jobs[indexes[index]]);
+			}
+		};
+		int count = max(1, min(threadcount, (int)indexes.size()));
+		vector<thread> threads;
+		for (int i=1; i<count; i++) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (int i=0; i<(int)threads.size(); i++) {
+			threads[i].join();
+		}
+	}
+
+	if (curves.getStores() > 0) {
+		curves.evict();
+	}
+}
+
+
+
+//////////////////////////////
+//
+// RollFanout::getJobs -- Return the variants in the order of the variants
+//     file.
+//
+
+vector<RollJob>& RollFanout::getJobs(void) {
+	return m_jobs;
+}
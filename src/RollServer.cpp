@@ -0,0 +1,424 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/src/RollServer.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Server which converts rolls sent over a socket.
+//
+
+#include "RollServer.h"
+#include "Expressionizer.h"
+#include "RollCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+	#include <errno.h>
+	#include <signal.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+
+//////////////////////////////
+//
+// RollServer::Connection::~Connection -- Close the socket of a client
+//     once the last response has been sent.
+//
+
+RollServer::Connection::~Connection() {
+#ifndef _WIN32
+	if (closeQ) {
+		close(outfd);
+	}
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::setDefaults -- Set the settings which the overrides of each
+//     request change.
+//
+
+void RollServer::setDefaults(const RollSettings& defaults) {
+	m_defaults = defaults;
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::setCache -- Set the cache of converted rolls (NULL for
+//     none).  Rolls in the cache are sent without being converted again.
+//
+
+void RollServer::setCache(RollCache* cache) {
+	m_cache = cache;
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::run -- Convert the rolls sent to a Unix domain socket, or
+//     through standard input and output if the path is "-", on threadcount
+//     threads until the program is stopped (or standard input ends).
+//     Returns false and prints a message to errors if the socket cannot be
+//     used.
+//
+
+bool RollServer::run(const string& path, int threadcount, ostream& errors) {
+#ifdef _WIN32
+	errors << "Error: server mode is not supported on Windows" << endl;
+	return false;
+#else
+	// a client which disconnects should not stop the server
+	signal(SIGPIPE, SIG_IGN);
+
+	m_closed = false;
+	threadcount = max(1, threadcount);
+	vector<thread> workers;
+	for (int i=0; i<threadcount; i++) {
+		workers.emplace_back(&RollServer::serveRequests, this);
+	}
+
+	bool status = true;
+	if (path == "-") {
+		shared_ptr<Connection> connection = make_shared<Connection>();
+		connection->outfd = 1;
+		serveConnection(0, connection);
+	} else {
+		int server = socket(AF_UNIX, SOCK_STREAM, 0);
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (server < 0) {
+			errors << "Error: cannot create socket: " << strerror(errno) << endl;
+			status = false;
+		} else if (path.size() >= sizeof(address.sun_path)) {
+			errors << "Error: socket path is too long: " << path << endl;
+			status = false;
+		} else {
+			strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+			unlink(path.c_str());
+			if ((bind(server, (struct sockaddr*)&address, sizeof(address)) < 0)
+					|| (listen(server, 64) < 0)) {
+				errors << "Error: cannot listen on " << path << ": " << strerror(errno) << endl;
+				status = false;
+			}
+		}
+		while (status) {
+			int client = accept(server, NULL, NULL);
+			if (client < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				errors << "Error: cannot accept connection: " << strerror(errno) << endl;
+				status = false;
+				break;
+			}
+			shared_ptr<Connection> connection = make_shared<Connection>();
+			connection->outfd = client;
+			connection->closeQ = true;
+			thread(&RollServer::serveConnection, this, client, connection).detach();
+		}
+		if (server >= 0) {
+			close(server);
+		}
+	}
+
+	{
+		lock_guard<mutex> guard(m_lock);
+		m_closed = true;
+	}
+	m_ready.notify_all();
+	for (int i=0; i<(int)workers.size(); i++) {
+		workers[i].join();
+	}
+	return status;
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::serveConnection -- Read the requests from a client and
+//     add them to the queue until the client closes the connection.
+//     Statistics requests are answered right away.
+//
+
+void RollServer::serveConnection(int infd, shared_ptr<Connection> connection) {
+	uint32_t id;
+	while (readFrameNumber(infd, id)) {
+		Request request;
+		request.id = id;
+		if (!readFrameString(infd, request.params) || !readFrameString(infd, request.midi)) {
+			break;
+		}
+		if (request.params == "stats") {
+			sendResponse(*connection, id, 0, 0.0, 0.0, getStatistics());
+			continue;
+		}
+		request.connection = connection;
+		request.received = chrono::steady_clock::now();
+		{
+			lock_guard<mutex> guard(m_lock);
+			m_requests.push_back(move(request));
+			int depth = (int)m_requests.size();
+			m_arrivals++;
+			m_depthSum += depth;
+			m_maxDepth = max(m_maxDepth, depth);
+		}
+		m_ready.notify_one();
+	}
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::serveRequests -- Convert the rolls in the queue (or copy
+//     them from the cache) until it is closed and empty.  The
+//     Expressionizer is reused (keeping its memory) for the next roll with
+//     the same settings, and a new one is set up when the settings change
+//     or a roll fails.
+//
+
+void RollServer::serveRequests(void) {
+	unique_ptr<Expressionizer> creator;
+	string setupParams;
+	stringstream errors;
+	Request request;
+	while (true) {
+		{
+			unique_lock<mutex> guard(m_lock);
+			m_ready.wait(guard, [this]() {
+				return m_closed || !m_requests.empty();
+			});
+			if (m_requests.empty()) {
+				return;
+			}
+			request = move(m_requests.front());
+			m_requests.pop_front();
+			m_active++;
+		}
+
+		auto start = chrono::steady_clock::now();
+		errors.str("");
+		stringstream output;
+		RollSettings settings = m_defaults;
+		bool status = settings.setOverrides(request.params, errors);
+		string key;
+		string check;
+		string cached;
+		if (status && m_cache) {
+			string description = settings.getKey();
+			key = RollCache::getKey(request.midi, description);
+			check = RollCache::getCheck(request.midi, description);
+		}
+		if (status && m_cache && m_cache->lookup(key, check, cached)) {
+			output.str(cached);
+		} else if (status) {
+			if (creator && (request.params == setupParams)) {
+				creator->reset();
+			} else {
+				creator.reset(new Expressionizer);
+				creator->setErrorStream(&errors);
+				settings.setupRoll(*creator, NULL);
+				setupParams = request.params;
+			}
+			istringstream input(request.midi);
+			if (!creator->readMidiFile(input)) {
+				errors << "Error: cannot read MIDI data" << endl;
+				status = false;
+			} else {
+				status = settings.expressRoll(*creator, NULL, NULL)
+						&& creator->writeMidiFile(output);
+			}
+			if (!status) {
+				// do not reuse an Expressionizer left in an unknown state
+				creator.reset();
+			} else if (m_cache && m_cache->store(key, check, output.str())
+					&& (m_cache->getStores() % 100 == 0)) {
+				// the directory is scanned for old entries every 100 rolls
+				m_cache->evict();
+			}
+		}
+		auto end = chrono::steady_clock::now();
+		double queued = chrono::duration<double>(start - request.received).count();
+		double work = chrono::duration<double>(end - start).count();
+
+		sendResponse(*request.connection, request.id, status ? 0 : 1, queued, work,
+				status ? output.str() : errors.str());
+		request.connection.reset();
+
+		lock_guard<mutex> guard(m_lock);
+		m_active--;
+		m_count++;
+		if (!status) {
+			m_errors++;
+		}
+		m_queueSum += queued;
+		m_workSum += work;
+		m_maxLatency = max(m_maxLatency, queued + work);
+	}
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::getStatistics -- Return the statistics of the server as
+//     lines of names and values.  Times are in milliseconds.
+//
+
+string RollServer::getStatistics(void) {
+	lock_guard<mutex> guard(m_lock);
+	stringstream output;
+	double count = m_count > 0 ? (double)m_count : 1.0;
+	output << "requests\t" << m_count << "\n";
+	output << "errors\t" << m_errors << "\n";
+	output << "queued\t" << m_requests.size() << "\n";
+	output << "active\t" << m_active << "\n";
+	output << "mean-queue-depth\t"
+	       << (m_arrivals > 0 ? m_depthSum / m_arrivals : 0.0) << "\n";
+	output << "max-queue-depth\t" << m_maxDepth << "\n";
+	output << "mean-wait-ms\t" << 1000.0 * m_queueSum / count << "\n";
+	output << "mean-work-ms\t" << 1000.0 * m_workSum / count << "\n";
+	output << "mean-latency-ms\t"
+	       << 1000.0 * (m_queueSum + m_workSum) / count << "\n";
+	output << "max-latency-ms\t" << 1000.0 * m_maxLatency << "\n";
+	if (m_cache) {
+		output << "cache-hits\t" << m_cache->getHits() << "\n";
+		output << "cache-misses\t" << m_cache->getMisses() << "\n";
+		output << "cache-evictions\t" << m_cache->getEvictions() << "\n";
+	}
+	return output.str();
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::sendResponse -- Send a response frame to a client.  The
+//     times are given in seconds and sent in microseconds.
+//
+
+void RollServer::sendResponse(Connection& connection, uint32_t id,
+		uint32_t status, double queued, double work, const string& payload) {
+	string data;
+	data.reserve(payload.size() + 20);
+	appendFrameNumber(data, id);
+	appendFrameNumber(data, status);
+	appendFrameNumber(data, (uint32_t)(queued * 1000000.0 + 0.5));
+	appendFrameNumber(data, (uint32_t)(work * 1000000.0 + 0.5));
+	appendFrameNumber(data, (uint32_t)payload.size());
+	data += payload;
+#ifndef _WIN32
+	lock_guard<mutex> guard(connection.writeMutex);
+	size_t written = 0;
+	while (written < data.size()) {
+		ssize_t count = write(connection.outfd, data.data() + written, data.size() - written);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// the client has gone away
+			return;
+		}
+		written += count;
+	}
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::readFrameNumber -- Read a 32-bit big-endian number.
+//     Returns false at the end of the input.
+//
+
+bool RollServer::readFrameNumber(int fd, uint32_t& value) {
+#ifdef _WIN32
+	return false;
+#else
+	unsigned char bytes[4];
+	size_t total = 0;
+	while (total < 4) {
+		ssize_t count = read(fd, bytes + total, 4 - total);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		total += count;
+	}
+	value = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16)
+			| ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+	return true;
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::readFrameString -- Read a string which is preceded by its
+//     length.  Returns false at the end of the input, or if the string is
+//     larger than 256 MB.
+//
+
+bool RollServer::readFrameString(int fd, string& value) {
+#ifdef _WIN32
+	return false;
+#else
+	uint32_t length;
+	if (!readFrameNumber(fd, length) || (length > (256u << 20))) {
+		return false;
+	}
+	value.resize(length);
+	size_t total = 0;
+	while (total < length) {
+		ssize_t count = read(fd, &value[total], length - total);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		total += count;
+	}
+	return true;
+#endif
+}
+
+
+
+//////////////////////////////
+//
+// RollServer::appendFrameNumber -- Add a 32-bit big-endian number to data.
+//
+
+void RollServer::appendFrameNumber(string& data, uint32_t value) {
+	data += (char)((value >> 24) & 0xff);
+	data += (char)((value >> 16) & 0xff);
+	data += (char)((value >> 8) & 0xff);
+	data += (char)(value & 0xff);
+}
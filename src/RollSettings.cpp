@@ -0,0 +1,452 @@
+//
+// Creation Date: Sun Oct 18 23:10:12 PDT 2026
+// Last Modified: Sun Oct 18 23:10:12 PDT 2026
+// Filename:      midi2exp/src/RollSettings.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Settings for converting one roll.
+//
+
+#include "RollSettings.h"
+#include "Expressionizer.h"
+#include "RollCache.h"
+
+#include <stdlib.h>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+using namespace std;
+using namespace smf;
+
+
+
+//////////////////////////////
+//
+// RollSettings::setOverride -- Change a setting from a key=value
+//     override: type, tempo, accel, remove-tracks, adjust-holes or
+//     compact.  Giving a roll type uses the standard tempo of that type
+//     instead of any tempo (see RollSettings.h).  Returns false for an
+//     unknown key or invalid value.
+//
+
+bool RollSettings::setOverride(const string& key, const string& value) {
+	if (key == "type") {
+		string name = value;
+		if (name == "red-welte") name = "red";
+		if (name == "green-welte") name = "green";
+		if (name == "licensee-welte") name = "licensee";
+		if ((name != "red") && (name != "green") && (name != "licensee")
+				&& (name != "88-note") && (name != "duo-art")) {
+			return false;
+		}
+		type = name;
+		typeTempo = true;
+		return true;
+	}
+
+	if ((key == "remove-tracks") || (key == "adjust-holes") || (key == "compact")) {
+		bool state;
+		if ((value == "1") || (value == "true")) {
+			state = true;
+		} else if ((value == "0") || (value == "false")) {
+			state = false;
+		} else {
+			return false;
+		}
+		if (key == "remove-tracks") {
+			removeTracks = state;
+		} else if (key == "adjust-holes") {
+			adjustHoles = state;
+		} else {
+			compact = state;
+		}
+		return true;
+	}
+
+	char* end = NULL;
+	double number = strtod(value.c_str(), &end);
+	if (value.empty() || (*end != '\0')) {
+		return false;
+	}
+	if (key == "tempo") {
+		if (number <= 0.0) {
+			return false;
+		}
+		tempoQ = true;
+		tempo = number;
+		return true;
+	}
+	if ((key == "accel") || (key == "acceleration")) {
+		if (number < 0.0) {
+			return false;
+		}
+		accelQ = true;
+		accel = number;
+		return true;
+	}
+	return false;
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::setOverrides -- Apply key=value overrides separated by
+//     spaces or tabs (the same as in a batch manifest).  Returns false and
+//     prints a message to errors if one is not valid.
+//
+
+bool RollSettings::setOverrides(const string& params, ostream& errors) {
+	istringstream input(params);
+	string field;
+	while (input >> field) {
+		size_t equals = field.find('=');
+		string key = field.substr(0, equals);
+		string value = equals == string::npos ? "" : field.substr(equals + 1);
+		if (!setOverride(key, value)) {
+			errors << "Error: invalid setting " << field << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::getKey -- Return a text with every setting which changes
+//     the output of a roll, and the version of the expression engine, for
+//     the keys of the cache.
+//
+
+string RollSettings::getKey(void) const {
+	stringstream key;
+	key.precision(17);
+	key << "engine\t" << Expressionizer::getEngineVersion() << "\n";
+	key << "type\t" << type << "\n";
+	key << "type-tempo\t" << typeTempo << "\n";
+	key << "tempo\t" << tempoQ << "\t" << tempo << "\n";
+	key << "accel\t" << accelQ << "\t" << accel << "\n";
+	key << "accel-max-error\t" << accelMaxErrorQ << "\t"
+	    << accelMaxError << "\n";
+	key << "punch-diameter\t" << punchDiameter << "\n";
+	key << "trackerbar-diameter\t" << trackerDiameter << "\n";
+	key << "punch-fraction\t" << punchFraction << "\n";
+	key << "remove-tracks\t" << removeTracks << "\n";
+	key << "adjust-holes\t" << adjustHoles << "\n";
+	key << "compact\t" << compact << "\n";
+	key << "remove-redundant\t" << removeRedundant << "\n";
+	key << "version\t" << versionQ << "\t" << version << "\n";
+	key << "date\t" << date << "\n";
+	for (int i=0; i<(int)parameters.size(); i++) {
+		key << parameters[i].first << "\t"
+		    << parameters[i].second << "\n";
+	}
+	return key.str();
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::getCurveKey -- Return a text with the settings which
+//     change the expression curves of a roll (the roll type, tempo,
+//     acceleration, hole adjustment and expression parameters).
+//
+
+string RollSettings::getCurveKey(void) const {
+	stringstream key;
+	key.precision(17);
+	key << type << "\t" << typeTempo << "\t"
+	    << tempoQ << "\t" << tempo << "\t"
+	    << accelQ << "\t" << accel << "\t"
+	    << adjustHoles << "\t" << punchDiameter << "\t"
+	    << trackerDiameter << "\t" << punchFraction;
+	for (int i=0; i<(int)parameters.size(); i++) {
+		key << "\t" << parameters[i].first << "="
+		    << parameters[i].second;
+	}
+	return key.str();
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::setupRoll -- Prepare a new Expressionizer for the roll
+//     type and hole settings.  This is done once for each Expressionizer,
+//     since the setup of a roll type depends on the expression parameters
+//     which expressRoll() changes.
+//
+
+void RollSettings::setupRoll(Expressionizer& creator, ostream* log) const {
+	creator.setupRedWelte();
+	if (type == "green") {
+		if (log) *log << "Processing Green Welte rolls" << endl;
+		creator.setupGreenWelte();
+	}
+	else if (type == "licensee") {
+		if (log) *log << "Processing Welte Licensee rolls" << endl;
+		creator.setupLicenseeWelte();
+	}
+	else if (type == "88-note") {
+		if (log) *log << "Processing 88-note rolls" << endl;
+		creator.setup88Roll();
+	}
+	else if (type == "duo-art") {
+		if (log) *log << "Processing Duo-art rolls" << endl;
+		creator.setupDuoArt();
+	}
+
+	creator.setPunchDiameter(punchDiameter);
+	creator.setTrackerbarDiameter(trackerDiameter);
+	creator.setPunchExtensionFraction(punchFraction);
+	if (removeTracks) {
+		creator.removeExpressionTracksOnWrite();
+	}
+	creator.setExpressionCache(expressionCache);
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::expressRoll -- Add expression to the roll which was read
+//     into creator, ready to be written.  Returns false if the expression
+//     cannot be added.
+//
+
+bool RollSettings::expressRoll(Expressionizer& creator, ostream* log,
+		ostream* report) const {
+	// default acceleration is 0.2, except for red Welte rolls
+	// green welte default tempo is 72.2222 if not specified.
+	if (typeTempo && (type == "red")) {
+		creator.setRollTempo(94.6);    //94.6
+		if (log) *log << "setting red welte tempo 94.6" << endl;
+		creator.setAcceleration(0.3147);
+	}
+	else if (typeTempo && (type == "green")) {
+		creator.setRollTempo(72.2);
+		if (log) *log << "setting green welte tempo 72.2" << endl;
+	}
+	// welte licensee tempo to be 79.8 by examining the test roll
+	else if (typeTempo && (type == "licensee")) {
+		creator.setRollTempo(79.8);
+		if (log) *log << "setting welte licensee tempo 79.8" << endl;
+	}
+	else if (typeTempo && (type == "88-note")) {
+		creator.setRollTempo(60);
+		if (log) *log << "setting 88-note roll tempo 60" << endl;
+	}
+	else if (typeTempo && (type == "duo-art")) {
+		creator.setRollTempo(70);
+		if (log) *log << "setting duo-art roll tempo 70" << endl;
+	}
+	else if (tempoQ) {
+		creator.setRollTempo(tempo);
+	}
+
+	for (int i=0; i<(int)parameters.size(); i++) {
+		const string& name = parameters[i].first;
+		double value = parameters[i].second;
+		if (name == "welte-piano") {
+			creator.setWelteP(value);
+		} else if (name == "welte-mezzo-forte") {
+			creator.setWelteMF(value);
+		} else if (name == "welte-forte") {
+			creator.setWelteF(value);
+		} else if (name == "welte-loud") {
+			creator.setWelteLoud(value);
+		} else if (name == "slow-decay-rate") {
+			creator.setSlowDecayRate(value);
+		} else if (name == "fast-crescendo") {
+			creator.setFastCrescendo(value);
+		} else if (name == "fast-decrescendo") {
+			creator.setFastDecrescendo(value);
+		}
+	}
+
+	if (adjustHoles) {
+		creator.applyTrackBarWidthCorrection();
+	}
+
+	if (versionQ) {
+		creator.setVersion(version);
+	}
+	creator.setDate(date);
+
+	if (accelQ) {
+		creator.setAcceleration(accel);
+	}
+	if (accelMaxErrorQ) {
+		creator.setAccelerationMaxError(accelMaxError / 1000.0);
+	}
+
+	if (compact) {
+		creator.setCompactOutput();
+	}
+	if (removeRedundant) {
+		creator.removeRedundantEventsOnWrite(report);
+	}
+
+	if (!creator.addExpression()) {
+		return false;
+	}
+	creator.setPianoTimbre();
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::convertRoll -- Add expression to a roll and write it to
+//     the output file.  Progress messages are printed to log if it is not
+//     NULL, removed redundant messages are listed in report, and errors
+//     and warnings are printed to errors.  The expression is printed to
+//     expression if it is not NULL (with the boolean states if extendedQ
+//     is true).  The cache is used if it is not NULL and neither is
+//     printed.  Returns false if the roll could not be read, converted or
+//     written.
+//
+
+bool RollSettings::convertRoll(const string& input, const string& output,
+		ostream* log, ostream* report, ostream& errors, RollCache* cache,
+		ostream* expression, bool extendedQ) const {
+	if (cache && !report && !expression) {
+		return convertCachedRoll(input, output, log, errors, *cache);
+	}
+
+	Expressionizer creator;
+	creator.setErrorStream(&errors);
+	setupRoll(creator, log);
+
+	if (!creator.readMidiFile(input)) {
+		errors << "Error: cannot read " << input << endl;
+		return false;
+	}
+
+	if (!expressRoll(creator, log, report)) {
+		return false;
+	}
+	if (!creator.writeMidiFile(output)) {
+		return false;
+	}
+	//creator.printVelocity();   // for debug
+
+	if (expression) {
+		creator.printExpression(*expression, extendedQ);
+	}
+
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::convertCachedRoll -- Copy the converted roll from the
+//     cache if it is there, otherwise convert it in memory and store it in
+//     the cache.  Warnings are only printed when the roll is converted,
+//     and without a fixed date a roll from the cache keeps the @EXP_DATE
+//     of its first conversion.
+//
+
+bool RollSettings::convertCachedRoll(const string& input, const string& output,
+		ostream* log, ostream& errors, RollCache& cache) const {
+	ifstream file(input, ios::binary);
+	if (!file.is_open()) {
+		errors << "Error: cannot read " << input << endl;
+		return false;
+	}
+	string midi((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	file.close();
+
+	string settings = getKey();
+	string key = RollCache::getKey(midi, settings);
+	string check = RollCache::getCheck(midi, settings);
+	string result;
+	if (cache.lookup(key, check, result)) {
+		if (log) *log << "Cache hit " << key << endl;
+		return writeOutputFile(output, result, errors);
+	}
+	if (log) *log << "Cache miss " << key << endl;
+
+	Expressionizer creator;
+	creator.setErrorStream(&errors);
+	setupRoll(creator, log);
+	istringstream in(midi);
+	if (!creator.readMidiFile(in)) {
+		errors << "Error: cannot read " << input << endl;
+		return false;
+	}
+	if (!expressRoll(creator, log, NULL)) {
+		return false;
+	}
+	stringstream out;
+	if (!creator.writeMidiFile(out)) {
+		return false;
+	}
+	result = out.str();
+	if (!cache.store(key, check, result)) {
+		errors << "Warning: cannot store " << input << " in the cache" << endl;
+	}
+	return writeOutputFile(output, result, errors);
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::writeOutputFile -- Write the bytes of an output file.
+//     Returns false and prints a message to errors if the file cannot be
+//     written.
+//
+
+bool RollSettings::writeOutputFile(const string& filename, const string& data,
+		ostream& errors) {
+	ofstream output(filename, ios::binary);
+	if (output.is_open()) {
+		output.write(data.data(), data.size());
+		output.close();
+	}
+	if (!output) {
+		errors << "Error: cannot write " << filename << endl;
+		return false;
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// RollSettings::getReproducibleDate -- Return the date for the metadata
+//     of reproducible output files: the time in the SOURCE_DATE_EPOCH
+//     environment variable (seconds since 1970, as used for reproducible
+//     builds) or else the start of 1970, in UTC and in the same format as
+//     the current time.
+//
+
+string RollSettings::getReproducibleDate(void) {
+	time_t seconds = 0;
+	const char* epoch = getenv("SOURCE_DATE_EPOCH");
+	if (epoch && *epoch) {
+		char* end = NULL;
+		long long value = strtoll(epoch, &end, 10);
+		if ((*end == '\0') && (value >= 0)) {
+			seconds = (time_t)value;
+		}
+	}
+	struct tm* utc = gmtime(&seconds);
+	char buffer[64] = {0};
+	if (utc) {
+		strftime(buffer, sizeof(buffer), "%a %b %e %H:%M:%S %Y", utc);
+	}
+	return buffer;
+}
@@ -0,0 +1,490 @@
+//
+// Creation Date: Sun Oct 18 21:30:04 PDT 2026
+// Last Modified: Sun Oct 18 21:30:04 PDT 2026
+// Filename:      midi2exp/src/m2e.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   C interface to the expression engine (see m2e.h).  The
+//                rolls are set up and converted by RollSettings, as in
+//                the midi2exp program, so that a roll converted through
+//                this interface is the same as one converted by midi2exp
+//                with the equivalent options.  No C++ exception leaves
+//                the interface.
+//
+
+#include "m2e.h"
+#include "Expressionizer.h"
+#include "RollSettings.h"
+
+#include <stdlib.h>
+#include <exception>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace smf;
+
+struct m2e_roll {
+	// settings (see m2e_set_param()):
+	RollSettings settings;
+
+	// creator is kept for the next roll until the settings change.
+	unique_ptr<Expressionizer> creator;
+	bool   changedQ        = true;
+
+	stringstream     errors;
+	string           errortext;
+	bool             nomemoryQ = false;  // no memory for errortext
+	string           output;
+	bool             notesQ = false;
+	vector<m2e_note> notes;
+};
+
+static bool m2e_setParam  (RollSettings& settings, const string& key,
+                           const char* value);
+static void m2e_setup     (m2e_roll* roll);
+static bool m2e_express   (m2e_roll* roll);
+static void m2e_catch     (m2e_roll* roll);
+static bool m2e_getNumber (const char* value, double& number);
+static bool m2e_getBoolean(const char* value, bool& state);
+static void m2e_getNotes  (m2e_roll* roll);
+
+
+
+//////////////////////////////
+//
+// m2e_get_abi_version -- Return the version of the C interface
+//     (M2E_ABI_VERSION when the library was built).
+//
+
+int m2e_get_abi_version(void) {
+	return M2E_ABI_VERSION;
+}
+
+
+
+//////////////////////////////
+//
+// m2e_create -- Return a new roll handle with the default settings of
+//     midi2exp, or NULL if there is not enough memory.
+//
+
+m2e_roll* m2e_create(void) {
+	try {
+		return new m2e_roll;
+	} catch (...) {
+		return NULL;
+	}
+}
+
+
+
+//////////////////////////////
+//
+// m2e_free -- Delete a roll handle (and its output buffer).
+//
+
+void m2e_free(m2e_roll* roll) {
+	delete roll;
+}
+
+
+
+//////////////////////////////
+//
+// m2e_set_param -- Change a setting for the next rolls.  The names are
+//     the long option names of midi2exp:
+//
+//     type                      red, green, licensee, 88-note or duo-art
+//                               (also sets the standard tempo of the type)
+//     tempo                     roll tempo (only used if no type is set;
+//                               see RollSettings.h)
+//     accel                     acceleration in feet per minute^2
+//     accel-max-error           max timing error of acceleration in ms
+//     punch-diameter            hole punch diameter in pixels
+//     trackerbar-diameter       tracker bar height in pixels
+//     punch-fraction            fraction of the tracker bar to extend holes
+//     adjust-hole-lengths       0/1: simulate the tracker bar width
+//     remove-expression-tracks  0/1: remove tracks 3 and 4 from the output
+//     compact                   0/1: write with running status
+//     remove-redundant          0/1: remove messages which change nothing
+//     version                   version metadata to add
+//     date                      fixed date for the metadata instead of the
+//                               current time (for identical output files)
+//     welte-piano, welte-mezzo-forte, welte-forte, welte-loud,
+//     slow-decay-rate, fast-crescendo, fast-decrescendo
+//                               expression parameters
+//
+//     Returns -1 for an unknown name or invalid value (or if there is not
+//     enough memory).
+//
+
+int m2e_set_param(m2e_roll* roll, const char* name, const char* value) {
+	if ((roll == NULL) || (name == NULL) || (value == NULL)) {
+		return -1;
+	}
+	try {
+		if (!m2e_setParam(roll->settings, name, value)) {
+			return -1;
+		}
+	} catch (...) {
+		return -1;
+	}
+	roll->changedQ = true;
+	return 0;
+}
+
+
+
+//////////////////////////////
+//
+// m2e_process_buffer -- Add expression to a roll given as the bytes of a
+//     MIDI file.  The output MIDI file is stored in the handle and is
+//     valid until the next call to m2e_process_buffer() or m2e_free().
+//     Returns -1 if the roll cannot be converted (see m2e_get_error()).
+//
+
+int m2e_process_buffer(m2e_roll* roll, const unsigned char* input, size_t size,
+		const unsigned char** output, size_t* outsize) {
+	if ((roll == NULL) || ((input == NULL) && (size > 0))) {
+		return -1;
+	}
+	roll->errors.str("");
+	roll->errors.clear();
+	roll->errortext.clear();
+	roll->nomemoryQ = false;
+	roll->output.clear();
+	roll->notes.clear();
+	roll->notesQ = false;
+	if (output) {
+		*output = NULL;
+	}
+	if (outsize) {
+		*outsize = 0;
+	}
+
+	bool status = false;
+	try {
+		m2e_setup(roll);
+		stringstream data(string((const char*)input, size));
+		if (!roll->creator->readMidiFile(data)) {
+			roll->errors << "Error: cannot read MIDI data" << endl;
+		} else {
+			status = m2e_express(roll);
+		}
+		roll->errortext = roll->errors.str();
+	} catch (...) {
+		m2e_catch(roll);
+		status = false;
+	}
+	if (!status) {
+		// do not reuse an Expressionizer left in an unknown state
+		roll->creator.reset();
+		return -1;
+	}
+	if (output) {
+		*output = (const unsigned char*)roll->output.data();
+	}
+	if (outsize) {
+		*outsize = roll->output.size();
+	}
+	return 0;
+}
+
+
+
+//////////////////////////////
+//
+// m2e_get_error -- Return the error and warning messages of the last
+//     call to m2e_process_buffer().
+//
+
+const char* m2e_get_error(m2e_roll* roll) {
+	if (roll == NULL) {
+		return "Error: no roll handle";
+	}
+	if (roll->nomemoryQ) {
+		return "Error: not enough memory";
+	}
+	return roll->errortext.c_str();
+}
+
+
+
+//////////////////////////////
+//
+// m2e_get_note_count -- Return the number of notes in the last roll
+//     converted by m2e_process_buffer().
+//
+
+int m2e_get_note_count(m2e_roll* roll) {
+	if (roll == NULL) {
+		return 0;
+	}
+	try {
+		m2e_getNotes(roll);
+	} catch (...) {
+		roll->notes.clear();
+		return 0;
+	}
+	return (int)roll->notes.size();
+}
+
+
+
+//////////////////////////////
+//
+// m2e_get_notes -- Copy up to count notes of the last converted roll
+//     (bass notes first, each register in time order) into notes.
+//     Returns the number of notes copied.
+//
+
+int m2e_get_notes(m2e_roll* roll, m2e_note* notes, int count) {
+	if ((roll == NULL) || (notes == NULL) || (count <= 0)) {
+		return 0;
+	}
+	try {
+		m2e_getNotes(roll);
+	} catch (...) {
+		roll->notes.clear();
+		return 0;
+	}
+	int size = (int)roll->notes.size();
+	if (count > size) {
+		count = size;
+	}
+	for (int i=0; i<count; i++) {
+		notes[i] = roll->notes[i];
+	}
+	return count;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////
+//
+// Static functions:
+//
+
+
+//////////////////////////////
+//
+// m2e_setup -- Prepare the Expressionizer for the next roll: reuse the
+//     one from the previous roll if the settings have not changed, since
+//     the setup of a roll type depends on the expression parameters.
+//
+
+static void m2e_setup(m2e_roll* roll) {
+	if (roll->creator && !roll->changedQ) {
+		roll->creator->reset();
+		return;
+	}
+	roll->creator.reset(new Expressionizer);
+	roll->changedQ = false;
+	roll->creator->setErrorStream(&roll->errors);
+	roll->settings.setupRoll(*roll->creator, NULL);
+}
+
+
+
+//////////////////////////////
+//
+// m2e_express -- Add expression to the roll which was read, and write
+//     the output MIDI file into the handle.
+//
+
+static bool m2e_express(m2e_roll* roll) {
+	Expressionizer& creator = *roll->creator;
+	if (!roll->settings.expressRoll(creator, NULL, NULL)) {
+		return false;
+	}
+	stringstream output;
+	if (!creator.writeMidiFile(output)) {
+		return false;
+	}
+	roll->output = output.str();
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// m2e_catch -- Store the message for an exception thrown while converting
+//     a roll (called from a catch block).  If there is not enough memory
+//     left for the message, m2e_get_error() returns a fixed one.
+//
+
+static void m2e_catch(m2e_roll* roll) {
+	string message;
+	try {
+		try {
+			throw;
+		} catch (const bad_alloc&) {
+			message = "Error: not enough memory";
+		} catch (const exception& error) {
+			message = string("Error: ") + error.what();
+		} catch (...) {
+			message = "Error: unknown exception";
+		}
+		roll->errortext = roll->errors.str() + message + "\n";
+	} catch (...) {
+		roll->errortext.clear();
+		roll->nomemoryQ = true;
+	}
+}
+
+
+
+//////////////////////////////
+//
+// m2e_setParam -- Change a setting (see m2e_set_param()).  Returns false
+//     for an unknown name or invalid value.
+//
+
+static bool m2e_setParam(RollSettings& settings, const string& key,
+		const char* value) {
+	double number = 0.0;
+	bool state = false;
+	bool numberQ = m2e_getNumber(value, number);
+
+	// settings shared with batch manifests, fan-out variants and server
+	// requests:
+	if ((key == "type") || (key == "tempo") || (key == "accel")
+			|| (key == "compact")) {
+		return settings.setOverride(key, value);
+	} else if (key == "accel-ft-per-min2") {
+		return settings.setOverride("accel", value);
+	} else if (key == "adjust-hole-lengths") {
+		return settings.setOverride("adjust-holes", value);
+	} else if (key == "remove-expression-tracks") {
+		return settings.setOverride("remove-tracks", value);
+	}
+
+	if (key == "accel-max-error") {
+		if (!numberQ || (number <= 0.0)) {
+			return false;
+		}
+		settings.accelMaxErrorQ = true;
+		settings.accelMaxError = number;
+	} else if (key == "punch-diameter") {
+		if (!numberQ) {
+			return false;
+		}
+		settings.punchDiameter = number;
+	} else if (key == "trackerbar-diameter") {
+		if (!numberQ) {
+			return false;
+		}
+		settings.trackerDiameter = number;
+	} else if (key == "punch-fraction") {
+		if (!numberQ) {
+			return false;
+		}
+		settings.punchFraction = number;
+	} else if (key == "remove-redundant") {
+		if (!m2e_getBoolean(value, state)) {
+			return false;
+		}
+		settings.removeRedundant = state;
+	} else if (key == "version") {
+		settings.versionQ = true;
+		settings.version = value;
+	} else if (key == "date") {
+		settings.date = value;
+	} else if ((key == "welte-piano") || (key == "welte-mezzo-forte")
+			|| (key == "welte-forte") || (key == "welte-loud")
+			|| (key == "slow-decay-rate") || (key == "fast-crescendo")
+			|| (key == "fast-decrescendo")) {
+		if (!numberQ) {
+			return false;
+		}
+		int i;
+		for (i=0; i<(int)settings.parameters.size(); i++) {
+			if (settings.parameters[i].first == key) {
+				settings.parameters[i].second = number;
+				break;
+			}
+		}
+		if (i == (int)settings.parameters.size()) {
+			settings.parameters.emplace_back(key, number);
+		}
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// m2e_getNumber -- Convert a whole string to a number.
+//
+
+static bool m2e_getNumber(const char* value, double& number) {
+	char* end = NULL;
+	number = strtod(value, &end);
+	return (end != value) && (*end == '\0');
+}
+
+
+
+//////////////////////////////
+//
+// m2e_getBoolean -- Convert "0", "1", "false" or "true" to a boolean.
+//
+
+static bool m2e_getBoolean(const char* value, bool& state) {
+	string text = value;
+	if ((text == "1") || (text == "true")) {
+		state = true;
+		return true;
+	}
+	if ((text == "0") || (text == "false")) {
+		state = false;
+		return true;
+	}
+	return false;
+}
+
+
+
+//////////////////////////////
+//
+// m2e_getNotes -- Store the note-ons of the bass and treble registers of
+//     the last converted roll in the handle, if not already done.
+//
+
+static void m2e_getNotes(m2e_roll* roll) {
+	if (roll->notesQ || !roll->creator) {
+		return;
+	}
+	MidiRoll& midifile = roll->creator->getMidiData();
+	midifile.doTimeAnalysis();
+	for (int track=1; (track<=2) && (track<midifile.getTrackCount()); track++) {
+		MidiEventList& events = midifile[track];
+		for (int i=0; i<events.getEventCount(); i++) {
+			if (!events[i].isNoteOn()) {
+				continue;
+			}
+			m2e_note note;
+			note.track    = track;
+			note.key      = events[i].getKeyNumber();
+			note.velocity = events[i].getVelocity();
+			note.tick     = events[i].tick;
+			note.seconds  = events[i].seconds;
+			roll->notes.push_back(note);
+		}
+	}
+	roll->notesQ = true;
+}
+
+
+
@@ -39,6 +39,7 @@ MidiEventList::MidiEventList(void) {
 //
 
 MidiEventList::MidiEventList(const MidiEventList& other) {
+	m_rawdata = other.m_rawdata;
 	list.reserve(other.list.size());
 	auto it = other.list.begin();
 	std::generate_n(std::back_inserter(list), other.list.size(), [&]() -> MidiEvent* {
@@ -56,6 +57,8 @@ MidiEventList::MidiEventList(const MidiEventList& other) {
 MidiEventList::MidiEventList(MidiEventList&& other) {
    list = std::move(other.list);
    other.list.clear();
+   m_rawdata = std::move(other.m_rawdata);
+   other.m_rawdata.clear();
 }
 
 
@@ -68,6 +71,10 @@ MidiEventList::MidiEventList(MidiEventList&& other) {
 
 MidiEventList::~MidiEventList() {
 	clear();
+	for (int i=0; i<(int)m_spareevents.size(); i++) {
+		delete m_spareevents[i];
+	}
+	m_spareevents.clear();
 }
 
 
@@ -148,6 +155,21 @@ void MidiEventList::clear(void) {
 		}
 	}
 	list.resize(0);
+	m_rawdata.clear();
+	resetLinkState();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::hasRawData -- Returns true if the track was not parsed
+//    when the MIDI file was read, and its original bytes are stored
+//    instead (see MidiFile::read()).
+//
+
+bool MidiEventList::hasRawData(void) const {
+	return !m_rawdata.empty();
 }
 
 
@@ -206,18 +228,68 @@ int MidiEventList::getEventCount(void) const {
 
 
 
+//////////////////////////////
+//
+// MidiEventList::recycle -- Remove all MidiEvents from the list like
+//    clear(), but keep them (and the storage of their messages) for
+//    reuse by later calls to append().  The memory is released when the
+//    list is deleted.
+//
+
+void MidiEventList::recycle(void) {
+	for (int i=0; i<(int)list.size(); i++) {
+		if (list[i] != NULL) {
+			m_spareevents.push_back(list[i]);
+		}
+	}
+	list.resize(0);
+	m_rawdata.clear();
+	resetLinkState();
+}
+
+
+
 //////////////////////////////
 //
 // MidiEventList::append -- add a MidiEvent at the end of the list.  Returns
-//     the index of the appended event.
+//     the index of the appended event.  An event left by recycle() or
+//     removeEmpties() is reused if available.
 //
 
 int MidiEventList::append(MidiEvent& event) {
-	MidiEvent* ptr = new MidiEvent(event);
+	MidiEvent* ptr;
+	if (m_spareevents.empty()) {
+		ptr = new MidiEvent(event);
+	} else {
+		ptr = m_spareevents.back();
+		m_spareevents.pop_back();
+		*ptr = event;
+	}
 	list.push_back(ptr);
 	return (int)list.size()-1;
 }
 
+
+
+//////////////////////////////
+//
+// MidiEventList::getSpareEvent -- Return an empty MidiEvent to be added
+//     to the list, reusing one left by recycle() or removeEmpties() if
+//     available.  The caller is responsible for adding it to the list.
+//
+
+MidiEvent* MidiEventList::getSpareEvent(void) {
+	if (m_spareevents.empty()) {
+		return new MidiEvent;
+	}
+	MidiEvent* event = m_spareevents.back();
+	m_spareevents.pop_back();
+	*event = MidiEvent();
+	return event;
+}
+
+
+
 //
 // MidiEventList::push -- Alias for MidiEventList::append().
 //
@@ -239,30 +311,25 @@ int MidiEventList::push_back(MidiEvent& event) {
 //////////////////////////////
 //
 // MidiEventList::removeEmpties -- Remove any MIDI message which contain no
-//    bytes.  This function first deallocates any empty MIDI events, and then
-//    removes them from the list of events.
+//    bytes.  The empty MIDI events are kept for reuse by append(), and the
+//    remaining events are moved up in the list.
 //
 
 void MidiEventList::removeEmpties(void) {
 	int count = 0;
 	for (int i=0; i<(int)list.size(); i++) {
 		if (list[i]->empty()) {
-			delete list[i];
-			list[i] = NULL;
+			m_spareevents.push_back(list[i]);
 			count++;
+		} else if (count > 0) {
+			list[i - count] = list[i];
 		}
 	}
 	if (count == 0) {
 		return;
 	}
-	std::vector<MidiEvent*> newlist;
-	newlist.reserve(list.size() - count);
-	for (int i=0; i<(int)list.size(); i++) {
-		if (list[i]) {
-			newlist.push_back(list[i]);
-		}
-	}
-	list.swap(newlist);
+	list.resize(list.size() - count);
+	resetLinkState();
 }
 
 
@@ -276,7 +343,8 @@ void MidiEventList::removeEmpties(void) {
 //   first note-off affects the last note-on, but both methods could
 //   be implemented with user selectability.  The current state of the
 //   track is assumed to be in time-sorted order.  Returns the number
-//   of linked notes (note-on/note-off pairs).
+//   of linked notes (note-on/note-off pairs).  On/off controllers such
+//   as the sustain pedal are also linked unless notesonly is true.
 //
 
 int MidiEventList::linkEventPairs(void) {
@@ -284,18 +352,29 @@ int MidiEventList::linkEventPairs(void) {
 }
 
 
-int MidiEventList::linkNotePairs(void) {
+int MidiEventList::linkNotePairs(bool notesonly) {
+	resetLinkState();
+	m_linknotesonly = notesonly;
+	return linkAppendedNotePairs();
+}
 
-	// Note-on states:
-	// dimension 1: MIDI channel (0-15)
-	// dimension 2: MIDI key     (0-127)  (but 0 not used for note-ons)
-	// dimension 3: List of active note-ons or note-offs.
-	std::vector<std::vector<std::vector<MidiEvent*>>> noteons;
-	noteons.resize(16);
-	int i;
-	for (i=0; i<(int)noteons.size(); i++) {
-		noteons[i].resize(128);
-	}
+
+
+//////////////////////////////
+//
+// MidiEventList::linkAppendedNotePairs -- Link events which have been
+//   appended to the list since the last call to linkNotePairs() or
+//   linkAppendedNotePairs(), continuing from the note-ons and controller
+//   on-states that were still waiting for a match at the end of the
+//   previous linking.  Events before that point are not relinked.  The
+//   note-only setting of the last linkNotePairs() call is used.  If the
+//   list has been sorted, cleared or had events removed since the last
+//   linking, the whole list is linked again.  Changing the contents of
+//   already-linked events requires calling linkNotePairs() instead.
+//   Returns the number of newly linked notes.
+//
+
+int MidiEventList::linkAppendedNotePairs(void) {
 
 	// Controller linking: The following General MIDI controller numbers are
 	// also monitored for linking within the track (but not between tracks).
@@ -319,101 +398,105 @@ int MidiEventList::linkNotePairs(void) {
 	// 5A  90   Undefined on/off                        0..63=off  64..127=on
 	// 7A 122   Local Keyboard On/Off                   0..63=off  64..127=on
 
-	// first keep track of whether the controller is an on/off switch:
-	std::vector<std::pair<int, int>> contmap;
-	contmap.resize(128);
-	std::pair<int, int> zero(0, 0);
-	std::fill(contmap.begin(), contmap.end(), zero);
-	contmap[64].first  = 1;   contmap[64].second = 0;
-	contmap[65].first  = 1;   contmap[65].second = 1;
-	contmap[66].first  = 1;   contmap[66].second = 2;
-	contmap[67].first  = 1;   contmap[67].second = 3;
-	contmap[68].first  = 1;   contmap[68].second = 4;
-	contmap[69].first  = 1;   contmap[69].second = 5;
-	contmap[80].first  = 1;   contmap[80].second = 6;
-	contmap[81].first  = 1;   contmap[81].second = 7;
-	contmap[82].first  = 1;   contmap[82].second = 8;
-	contmap[83].first  = 1;   contmap[83].second = 9;
-	contmap[84].first  = 1;   contmap[84].second = 10;
-	contmap[85].first  = 1;   contmap[85].second = 11;
-	contmap[86].first  = 1;   contmap[86].second = 12;
-	contmap[87].first  = 1;   contmap[87].second = 13;
-	contmap[88].first  = 1;   contmap[88].second = 14;
-	contmap[89].first  = 1;   contmap[89].second = 15;
-	contmap[90].first  = 1;   contmap[90].second = 16;
-	contmap[122].first = 1;   contmap[122].second = 17;
-
-	// dimensions:
-	// 1: mapped controller (0 to 17)
-	// 2: channel (0 to 15)
-	std::vector<std::vector<MidiEvent*>> contevents;
-	contevents.resize(18);
-	std::vector<std::vector<int>> oldstates;
-	oldstates.resize(18);
-	for (int i=0; i<18; i++) {
-		contevents[i].resize(16);
-		std::fill(contevents[i].begin(), contevents[i].end(), nullptr);
-		oldstates[i].resize(16);
-		std::fill(oldstates[i].begin(), oldstates[i].end(), -1);
+	int count = getEventCount();
+	if ((m_linkedcount > count) || ((m_linkedcount > 0)
+			&& (list[m_linkedcount - 1] != m_linkedlast))) {
+		resetLinkState();
+	}
+	int i;
+	for (i=m_linkedcount; i<count; i++) {
+		list[i]->unlinkEvent();
+	}
+
+	// Active note-ons for each channel/key: the most recent note-on is
+	// stored in the array, and older unmatched note-ons on the same
+	// channel/key are chained behind it through their (otherwise unused)
+	// link pointers.
+	MidiEvent* noteons[16 * 128];
+	std::fill(noteons, noteons + 16 * 128, nullptr);
+
+	// Controller on-states waiting for an off-state (indexed by mapped
+	// controller number (0 to 17) * 16 + channel).
+	MidiEvent* conton[18 * 16];
+	std::fill(conton, conton + 18 * 16, nullptr);
+
+	int slot;
+	MidiEvent* mev;
+	for (i=0; i<(int)m_pendinglinks.size(); i++) {
+		mev = m_pendinglinks[i];
+		mev->unlinkEvent();
+		if (mev->isNoteOn()) {
+			slot = mev->getChannel() * 128 + mev->getKeyNumber();
+			mev->m_eventlink = noteons[slot];
+			noteons[slot] = mev;
+		} else {
+			slot = getControllerLinkSlot(mev->getP1()) * 16 + mev->getChannel();
+			conton[slot] = mev;
+		}
 	}
+	m_pendinglinks.clear();
 
-	// Now iterate through the MidiEventList keeping track of note and
+	// Now iterate through the new MidiEvents keeping track of note and
 	// select controller states and linking notes/controllers as needed.
-	int channel;
-	int key;
-	int contnum;
-	int contval;
-	int conti;
-	int contstate;
 	int counter = 0;
-	MidiEvent* mev;
+	int conti;
 	MidiEvent* noteon;
-	for (i=0; i<getSize(); i++) {
-		mev = &getEvent(i);
-		mev->unlinkEvent();
+	for (i=m_linkedcount; i<count; i++) {
+		mev = list[i];
 		if (mev->isNoteOn()) {
 			// store the note-on to pair later with a note-off message.
-			key = mev->getKeyNumber();
-			channel = mev->getChannel();
-			noteons[channel][key].push_back(mev);
+			slot = mev->getChannel() * 128 + mev->getKeyNumber();
+			mev->m_eventlink = noteons[slot];
+			noteons[slot] = mev;
 		} else if (mev->isNoteOff()) {
-			key = mev->getKeyNumber();
-			channel = mev->getChannel();
-			if (noteons[channel][key].size() > 0) {
-				noteon = noteons[channel][key].back();
-				noteons[channel][key].pop_back();
+			slot = mev->getChannel() * 128 + mev->getKeyNumber();
+			noteon = noteons[slot];
+			if (noteon) {
+				noteons[slot] = noteon->m_eventlink;
+				noteon->m_eventlink = NULL;
 				noteon->linkEvent(mev);
 				counter++;
 			}
-		} else if (mev->isController()) {
-			contnum = mev->getP1();
-			if (contmap[contnum].first) {
-				conti     = contmap[contnum].second;
-				channel   = mev->getChannel();
-				contval   = mev->getP2();
-				contstate = contval < 64 ? 0 : 1;
-				if ((oldstates[conti][channel] == -1) && contstate) {
-					// a newly initialized onstate was detected, so store for
-					// later linking to an off state.
-					contevents[conti][channel] = mev;
-					oldstates[conti][channel] = contstate;
-				} else if (oldstates[conti][channel] == contstate) {
-					// the controller state is redundant and will be ignored.
-				} else if ((oldstates[conti][channel] == 0) && contstate) {
-					// controller is currently off, so store on-state for next link
-					contevents[conti][channel] = mev;
-					oldstates[conti][channel] = contstate;
-				} else if ((oldstates[conti][channel] == 1) && (contstate == 0)) {
-					// controller has just been turned off, so link to
-					// stored on-message.
-					contevents[conti][channel]->linkEvent(mev);
-					oldstates[conti][channel] = contstate;
-					// not necessary, but maybe use for something later:
-					contevents[conti][channel] = mev;
+		} else if ((!m_linknotesonly) && mev->isController()) {
+			conti = getControllerLinkSlot(mev->getP1());
+			if (conti < 0) {
+				continue;
+			}
+			slot = conti * 16 + mev->getChannel();
+			if (mev->getP2() >= 64) {
+				// store the on-state for linking to the next off-state
+				// (redundant on-states are ignored).
+				if (conton[slot] == NULL) {
+					conton[slot] = mev;
 				}
+			} else if (conton[slot]) {
+				// controller has just been turned off, so link to
+				// stored on-message.
+				conton[slot]->linkEvent(mev);
+				conton[slot] = NULL;
 			}
 		}
 	}
+
+	// Save the unmatched events for the next incremental linking, oldest
+	// first, and clear the chain pointers of the unmatched note-ons.
+	int first;
+	for (slot=0; slot<16 * 128; slot++) {
+		first = (int)m_pendinglinks.size();
+		for (mev=noteons[slot]; mev; mev=noteon) {
+			noteon = mev->m_eventlink;
+			mev->m_eventlink = NULL;
+			m_pendinglinks.push_back(mev);
+		}
+		std::reverse(m_pendinglinks.begin() + first, m_pendinglinks.end());
+	}
+	for (slot=0; slot<18 * 16; slot++) {
+		if (conton[slot]) {
+			m_pendinglinks.push_back(conton[slot]);
+		}
+	}
+	m_linkedcount = count;
+	m_linkedlast  = count > 0 ? list[count - 1] : NULL;
 	return counter;
 }
 
@@ -428,6 +511,7 @@ void MidiEventList::clearLinks(void) {
 	for (int i=0; i<(int)getSize(); i++) {
 		getEvent(i).unlinkEvent();
 	}
+	resetLinkState();
 }
 
 
@@ -486,6 +570,7 @@ int MidiEventList::markSequence(int sequence) {
 
 void MidiEventList::detach(void) {
 	list.resize(0);
+	resetLinkState();
 }
 
 
@@ -511,6 +596,9 @@ int MidiEventList::push_back_no_copy(MidiEvent* event) {
 
 MidiEventList& MidiEventList::operator=(MidiEventList& other) {
 	list.swap(other.list);
+	m_rawdata.swap(other.m_rawdata);
+	resetLinkState();
+	other.resetLinkState();
 	return *this;
 }
 
@@ -526,10 +614,164 @@ MidiEventList& MidiEventList::operator=(MidiEventList& other) {
 //    track of delta versus absolute tick states of the MidiEventList,
 //    and sorting is only allowed in absolute tick state (The MidiEventList
 //    does not know about delta/absolute tick states of its contents).
+//    Events which eventcompare() does not order keep their current order,
+//    so the result is the same with every C++ library (qsort() orders
+//    them differently on different systems).  A list which is already in
+//    order is left alone.  Otherwise short runs are insertion sorted and
+//    then merged back and forth with m_sortbuffer, which keeps its
+//    capacity so that sorting a reused list does not allocate memory
+//    (std::stable_sort() allocates a new buffer each time).
 //
 
 void MidiEventList::sort(void) {
-	qsort(data(), getEventCount(), sizeof(MidiEvent*), eventcompare);
+	auto before = [](MidiEvent* a, MidiEvent* b) {
+		return eventcompare(&a, &b) < 0;
+	};
+	int count = (int)list.size();
+	int i;
+	for (i=1; i<count; i++) {
+		if (before(list[i], list[i-1])) {
+			break;
+		}
+	}
+	if (i < count) {
+		const int run = 16;
+		for (int start=0; start<count; start+=run) {
+			int end = std::min(start + run, count);
+			for (int j=start+1; j<end; j++) {
+				MidiEvent* event = list[j];
+				int k = j;
+				while ((k > start) && before(event, list[k-1])) {
+					list[k] = list[k-1];
+					k--;
+				}
+				list[k] = event;
+			}
+		}
+		m_sortbuffer.resize(count);
+		MidiEvent** source = list.data();
+		MidiEvent** target = m_sortbuffer.data();
+		for (int width=run; width<count; width*=2) {
+			for (int start=0; start<count; start+=2*width) {
+				int middle = std::min(start + width, count);
+				int end = std::min(start + 2 * width, count);
+				std::merge(source + start, source + middle, source + middle,
+						source + end, target + start, before);
+			}
+			std::swap(source, target);
+		}
+		if (source != list.data()) {
+			std::copy(source, source + count, list.data());
+		}
+	}
+	resetLinkState();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::shiftNoteOffs -- Private because the MidiFile class
+//    keeps track of delta versus absolute tick states (see sort()).
+//    Adds ticks to the note-offs (only the linked ones if linkedonly
+//    is true) and restores the sorted order.  The moved events keep their
+//    relative order, as do the other events, so the list is reordered
+//    in place by merging the two sequences: moved events wait in a queue
+//    until the next unmoved event sorts after them.  The queue only holds
+//    the note-offs within the shifting distance.  If the list is not
+//    in tick order, or if the note-offs move earlier, a full sort is done
+//    instead.
+//
+
+void MidiEventList::shiftNoteOffs(int ticks, bool linkedonly) {
+	int count = getEventCount();
+	if ((ticks == 0) || (count == 0)) {
+		return;
+	}
+	bool sorted = ticks > 0;
+	int i;
+	for (i=1; sorted && (i<count); i++) {
+		if (list[i]->tick < list[i-1]->tick) {
+			sorted = false;
+		}
+	}
+
+	std::vector<MidiEvent*> waiting;
+	int head = 0;
+	int output = 0;
+	MidiEvent* mev;
+	for (i=0; i<count; i++) {
+		mev = list[i];
+		if (mev->isNoteOff() && (!linkedonly || mev->isLinked())) {
+			mev->tick += ticks;
+			if (sorted) {
+				waiting.push_back(mev);
+			}
+			continue;
+		}
+		if (!sorted) {
+			continue;
+		}
+		while ((head < (int)waiting.size())
+				&& (eventcompare(&waiting[head], &mev) < 0)) {
+			list[output++] = waiting[head++];
+		}
+		if (head == (int)waiting.size()) {
+			waiting.clear();
+			head = 0;
+		}
+		list[output++] = mev;
+	}
+
+	if (sorted) {
+		while (head < (int)waiting.size()) {
+			list[output++] = waiting[head++];
+		}
+		resetLinkState();
+	} else {
+		sort();
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::resetLinkState -- Forget the state saved for incremental
+//    linking, so that the next call to linkAppendedNotePairs() will link
+//    the whole list.
+//
+
+void MidiEventList::resetLinkState(void) {
+	m_linkedcount = 0;
+	m_linkedlast  = NULL;
+	m_pendinglinks.clear();
+}
+
+
+
+//////////////////////////////
+//
+// MidiEventList::getControllerLinkSlot -- Return the index of an on/off
+//    controller which is linked by linkNotePairs(), or -1 if the
+//    controller is not linked.
+//
+
+int MidiEventList::getControllerLinkSlot(int controller) {
+	static const signed char slots[128] = {
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		 0,  1,  2,  3,  4,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		 6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 17, -1, -1, -1, -1, -1
+	};
+	if ((controller < 0) || (controller > 127)) {
+		return -1;
+	}
+	return slots[controller];
 }
 
 
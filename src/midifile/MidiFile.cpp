@@ -23,10 +23,152 @@
 #include <sstream>
 #include <iterator>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 
 namespace smf {
 
+//////////////////////////////
+//
+// _MemoryBuffer -- Stream buffer for reading from bytes in memory
+//     without copying them.
+//
+
+class _MemoryBuffer : public std::streambuf {
+	public:
+		_MemoryBuffer(const char* data, size_t size) {
+			char* start = const_cast<char*>(data);
+			setg(start, start, start + size);
+		}
+		size_t getPosition(void) const { return gptr() - eback(); }
+};
+
+
+//
+// _TrackErrors -- Messages for the track being processed by the current
+//     thread in MidiFile::forEachTrack().  They are passed on to the
+//     error stream in track order after all of the threads finish.
+//
+
+static thread_local std::ostream* _TrackErrors = NULL;
+
+
+
+//////////////////////////////
+//
+// _TrackJob -- One call of MidiFile::forEachTrack() which is shared by
+//     the calling thread and the workers of the _TrackPool.
+//
+
+class _TrackJob {
+	public:
+		_TrackJob(const std::function<void(int)>& function, int tracks)
+				: m_function(function), m_messages(tracks), m_next(0),
+				  m_tracks(tracks), m_helpers(0), m_active(0) { }
+
+		void run(void) {
+			int track;
+			while ((track = m_next++) < m_tracks) {
+				_TrackErrors = &m_messages[track];
+				m_function(track);
+			}
+			_TrackErrors = NULL;
+		}
+
+		const std::function<void(int)>& m_function;
+		std::vector<std::ostringstream> m_messages;
+		std::atomic<int> m_next;
+		int m_tracks;
+		int m_helpers;  // number of workers which may still join the job
+		int m_active;   // number of workers which are running the job
+};
+
+
+
+//////////////////////////////
+//
+// _TrackPool -- Worker threads which are shared by all MidiFiles.  The
+//     threads are started the first time a job needs them and then wait
+//     for more jobs, so that a parallel operation does not pay for
+//     starting threads each time.  The calling thread also works on its
+//     own job, so a job finishes even when all of the workers are busy.
+//
+
+class _TrackPool {
+	public:
+		~_TrackPool() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_stop = true;
+			lock.unlock();
+			m_wakeup.notify_all();
+			for (int i=0; i<(int)m_threads.size(); i++) {
+				m_threads[i].join();
+			}
+		}
+
+		static _TrackPool& getPool(void) {
+			static _TrackPool pool;
+			return pool;
+		}
+
+		void run(_TrackJob& job, int threadcount) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while ((int)m_threads.size() < threadcount - 1) {
+				m_threads.emplace_back(&_TrackPool::work, this);
+			}
+			job.m_helpers = threadcount - 1;
+			m_jobs.push_back(&job);
+			lock.unlock();
+			m_wakeup.notify_all();
+
+			job.run();
+
+			// Withdraw the job if not all helpers have taken it, then wait
+			// for the ones which did to finish their tracks.
+			lock.lock();
+			auto it = std::find(m_jobs.begin(), m_jobs.end(), &job);
+			if (it != m_jobs.end()) {
+				m_jobs.erase(it);
+			}
+			m_done.wait(lock, [&job]() { return job.m_active == 0; });
+		}
+
+	private:
+		void work(void) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (true) {
+				m_wakeup.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+				if (m_stop) {
+					return;
+				}
+				_TrackJob* job = m_jobs.front();
+				job->m_active++;
+				if (--job->m_helpers <= 0) {
+					m_jobs.pop_front();
+				}
+				lock.unlock();
+				job->run();
+				lock.lock();
+				if (--job->m_active == 0) {
+					m_done.notify_all();
+				}
+			}
+		}
+
+		std::mutex               m_mutex;
+		std::condition_variable  m_wakeup;  // workers wait here for jobs
+		std::condition_variable  m_done;    // callers wait here for workers
+		std::deque<_TrackJob*>   m_jobs;
+		std::vector<std::thread> m_threads;
+		bool                     m_stop = false;
+};
+
+
+
 //////////////////////////////
 //
 // MidiFile::MidiFile -- Constuctor.
@@ -79,10 +221,8 @@ MidiFile::MidiFile(MidiFile&& other) {
 MidiFile::~MidiFile() {
 	m_readFileName.clear();
 	clear();
-	if (m_events[0] != NULL) {
-		delete m_events[0];
-		m_events[0] = NULL;
-	}
+	releaseTrack(m_events[0]);
+	m_events[0] = NULL;
 	m_events.resize(0);
 	m_rwstatus = false;
 	m_timemap.clear();
@@ -93,20 +233,27 @@ MidiFile::~MidiFile() {
 
 //////////////////////////////
 //
-// MidiFile::operator= -- Copying another
+// MidiFile::operator= -- Copying another.  The track lists are shared
+//    with the other file rather than copied, and each file makes its own
+//    copy of a track only when it changes it, so copying a file only
+//    takes time for the number of tracks.  References to tracks or
+//    events taken from either file before the copy should not be used
+//    to change them afterwards.
 //
 
 MidiFile& MidiFile::operator=(const MidiFile& other) {
 	if (this == &other) {
 		return *this;
 	}
-	m_events.reserve(other.m_events.size());
-	auto it = other.m_events.begin();
-	std::generate_n(std::back_inserter(m_events), other.m_events.size(),
-		[&]()->MidiEventList* {
-			return new MidiEventList(**it++);
+	for (int i=0; i<(int)m_events.size(); i++) {
+		releaseTrack(m_events[i]);
+	}
+	m_events = other.m_events;
+	for (int i=0; i<(int)m_events.size(); i++) {
+		if (m_events[i] != NULL) {
+			m_events[i]->m_sharecount++;
 		}
-	);
+	}
 	m_ticksPerQuarterNote = other.m_ticksPerQuarterNote;
 	m_trackCount          = other.m_trackCount;
 	m_theTrackState       = other.m_theTrackState;
@@ -115,9 +262,11 @@ MidiFile& MidiFile::operator=(const MidiFile& other) {
 	m_timemapvalid        = other.m_timemapvalid;
 	m_timemap             = other.m_timemap;
 	m_rwstatus            = other.m_rwstatus;
-	if (other.m_linkedEventsQ) {
-		linkEventPairs();
-	}
+	m_compactencoding     = other.m_compactencoding;
+	m_threadcount         = other.m_threadcount;
+	m_parallelthreshold   = other.m_parallelthreshold;
+	m_errorstream         = other.m_errorstream;
+	m_linkedEventsQ       = other.m_linkedEventsQ;
 	return *this;
 }
 
@@ -136,6 +285,10 @@ MidiFile& MidiFile::operator=(MidiFile&& other) {
 	m_timemapvalid        = other.m_timemapvalid;
 	m_timemap             = other.m_timemap;
 	m_rwstatus            = other.m_rwstatus;
+	m_compactencoding     = other.m_compactencoding;
+	m_threadcount         = other.m_threadcount;
+	m_parallelthreshold   = other.m_parallelthreshold;
+	m_errorstream         = other.m_errorstream;
 	return *this;
 }
 
@@ -169,10 +322,57 @@ bool MidiFile::read(const std::string& filename) {
 }
 
 //
-// istream version of read().
+// Track-selective version of read(): only the tracks which are true in
+// trackmask are parsed (tracks past the end of the mask are not parsed).
+// The other tracks are skipped using the chunk sizes in the file and are
+// left empty.  If keepraw is true, the bytes of each unparsed track are
+// stored with the track, and they will be written back unchanged by
+// write() as long as no events are added to the track.
+//
+
+bool MidiFile::read(const std::string& filename,
+		const std::vector<bool>& trackmask, bool keepraw) {
+	m_timemapvalid = 0;
+	setFilename(filename);
+	m_rwstatus = true;
+
+	std::fstream input;
+	input.open(filename.c_str(), std::ios::binary | std::ios::in);
+
+	if (!input.is_open()) {
+		m_rwstatus = false;
+		return m_rwstatus;
+	}
+
+	m_rwstatus = read(input, trackmask, keepraw);
+	return m_rwstatus;
+}
+
+//
+// istream versions of read().
 //
 
 bool MidiFile::read(std::istream& input) {
+	return readStream(input, NULL, false);
+}
+
+
+bool MidiFile::read(std::istream& input, const std::vector<bool>& trackmask,
+		bool keepraw) {
+	return readStream(input, &trackmask, keepraw);
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::readStream -- Read a Standard MIDI File from a stream.
+//     If trackmask is not NULL, only the selected tracks are parsed
+//     (see read()).
+//
+
+bool MidiFile::readStream(std::istream& input,
+		const std::vector<bool>* trackmask, bool keepraw) {
 	m_rwstatus = true;
 	if (input.peek() != 'M') {
 		// If the first byte in the input stream is not 'M', then presume that
@@ -181,22 +381,461 @@ bool MidiFile::read(std::istream& input) {
 		// then continue reading with this function.
 		std::stringstream binarydata;
 		Binasc binasc;
+		binasc.setErrorStream(&getErrorStream());
 		binasc.writeToBinary(binarydata, input);
 		binarydata.seekg(0, std::ios_base::beg);
 		if (binarydata.peek() != 'M') {
-			std::cerr << "Bad MIDI data input" << std::endl;
+			getErrorStream() << "Bad MIDI data input" << std::endl;
 			m_rwstatus = false;
 			return m_rwstatus;
 		} else {
-			m_rwstatus = read(binarydata);
+			m_rwstatus = readStream(binarydata, trackmask, keepraw);
 			return m_rwstatus;
 		}
 	}
 
+	int tracks;
+	if (!readHeaderChunk(input, tracks)) {
+		m_rwstatus = false; return m_rwstatus;
+	}
+	allocateTracks(tracks);
+	std::vector<bool> selected(tracks, true);
+	for (int z=0; z<tracks; z++) {
+		if (trackmask) {
+			selected[z] = (z < (int)trackmask->size()) && (*trackmask)[z];
+		}
+		if (selected[z]) {
+			m_events[z]->reserve(10000);   // Initialize with 10,000 event storage.
+		}
+	}
+
+	//////////////////////////////////////////////////
+	//
+	// now read individual tracks:
+	//
+
+	if ((m_threadcount > 1) && (tracks > 1)) {
+		std::string data;
+		if (!readTrackChunks(input, tracks, data)
+				|| !readTracksParallel(data, selected, keepraw)) {
+			// the chunk sizes are not reliable, so parse the tracks in order
+			// from the rest of the input.
+			data.append(std::istreambuf_iterator<char>(input),
+					std::istreambuf_iterator<char>());
+			for (int z=0; z<tracks; z++) {
+				m_events[z]->recycle();
+			}
+			_MemoryBuffer buffer(data.data(), data.size());
+			std::istream datastream(&buffer);
+			m_rwstatus = readTracks(datastream, selected, keepraw);
+		}
+	} else {
+		m_rwstatus = readTracks(input, selected, keepraw);
+	}
+	if (!m_rwstatus) {
+		return m_rwstatus;
+	}
+
+	m_theTimeState = TIME_STATE_ABSOLUTE;
+	markSequence();
+	return m_rwstatus;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::readTracks -- Read the track chunks of a MIDI file in order,
+//     after the header has been read.  Tracks which are not selected
+//     are skipped, or stored as raw data if keepraw is true.
+//
+
+bool MidiFile::readTracks(std::istream& input,
+		const std::vector<bool>& selected, bool keepraw) {
+	ulong length;
+	for (int i=0; i<(int)selected.size(); i++) {
+		if (!readTrackChunkHeader(input, length)) {
+			return false;
+		}
+		if (selected[i]) {
+			if (!readTrackEvents(input, *m_events[i], i, length, false)) {
+				return false;
+			}
+			continue;
+		}
+		if (keepraw) {
+			std::vector<uchar>& rawdata = m_events[i]->m_rawdata;
+			rawdata.resize(length);
+			input.read((char*)rawdata.data(), length);
+			if ((ulong)input.gcount() != length) {
+				getErrorStream() << "In file " << getFilename() << ": unexpected end of file."
+				     << std::endl;
+				return false;
+			}
+		} else if (!skipTrackChunk(input, length)) {
+			getErrorStream() << "In file " << getFilename() << ": cannot skip track "
+			     << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::readTrackChunks -- Store the given number of track chunks
+//     (with their chunk headers) from the input in data, using the chunk
+//     sizes in the file, so that any data after the MIDI file in the
+//     input is left unread.  Returns false if a chunk is not a track
+//     chunk or the input ends too soon.
+//
+
+bool MidiFile::readTrackChunks(std::istream& input, int tracks,
+		std::string& data) {
+	char header[8];
+	for (int i=0; i<tracks; i++) {
+		input.read(header, 8);
+		data.append(header, (size_t)input.gcount());
+		if ((input.gcount() != 8) || (data.compare(data.size() - 8, 4, "MTrk") != 0)) {
+			return false;
+		}
+		const uchar* size = (const uchar*)header + 4;
+		ulong remaining = ((ulong)size[0] << 24) | ((ulong)size[1] << 16)
+				| ((ulong)size[2] << 8) | (ulong)size[3];
+		// read in pieces, so that a bad chunk size does not allocate
+		// more memory than the input holds.
+		while (remaining > 0) {
+			size_t count = remaining < 0x10000 ? remaining : 0x10000;
+			size_t position = data.size();
+			data.resize(position + count);
+			input.read(&data[position], count);
+			if ((size_t)input.gcount() != count) {
+				data.resize(position + (size_t)input.gcount());
+				return false;
+			}
+			remaining -= count;
+		}
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::readTracksParallel -- Read the track chunks of a MIDI file
+//     (the bytes after the header) with one thread per track, up to the
+//     thread count (see setThreadCount()).  The chunk boundaries are found
+//     first from the chunk sizes in the file.  Running status does not
+//     continue across track chunks, so each track can be parsed on its
+//     own.  Returns false if the chunk sizes do not match the track data
+//     (the end-of-track message must end each chunk), in which case the
+//     tracks should be read in order as is done by read().
+//
+
+bool MidiFile::readTracksParallel(const std::string& data,
+		const std::vector<bool>& selected, bool keepraw) {
+	int tracks = (int)selected.size();
+	std::vector<size_t> offsets(tracks);
+	std::vector<ulong> lengths(tracks);
+	size_t position = 0;
+	int i;
+	for (i=0; i<tracks; i++) {
+		if ((position + 8 > data.size()) || (data.compare(position, 4, "MTrk") != 0)) {
+			return false;
+		}
+		const uchar* size = (const uchar*)data.data() + position + 4;
+		lengths[i] = ((ulong)size[0] << 24) | ((ulong)size[1] << 16)
+				| ((ulong)size[2] << 8) | (ulong)size[3];
+		offsets[i] = position + 8;
+		position = offsets[i] + lengths[i];
+		if (position > data.size()) {
+			return false;
+		}
+	}
+
+	std::vector<int> ok(tracks, 1);
+	forEachTrack([&](int track) {
+		if (!selected[track]) {
+			if (keepraw) {
+				m_events[track]->m_rawdata.assign(data.begin() + offsets[track],
+						data.begin() + offsets[track] + lengths[track]);
+			}
+			return;
+		}
+		// each track has its own parser, since errors are stored in it.
+		// Its messages are discarded since a bad track is read again.
+		MidiFile parser;
+		parser.setErrorStream(NULL);
+		_MemoryBuffer buffer(data.data() + offsets[track], lengths[track]);
+		std::istream chunk(&buffer);
+		MidiEventList& events = *m_events[track];
+		if (!parser.readTrackEvents(chunk, events, track, lengths[track], false)
+				|| (events.getEventCount() == 0) || !events.last().isEndOfTrack()
+				|| (buffer.getPosition() != lengths[track])) {
+			ok[track] = 0;
+		}
+	}, true);
+
+	for (i=0; i<tracks; i++) {
+		if (!ok[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setCompactEncoding -- Write MIDI files with fewer bytes by
+//     using running status and by writing note-offs with a release
+//     velocity of 0 as note-ons with velocity 0 (see
+//     encodeCompactMessage()).  Default is off, which writes each message
+//     as it is stored.
+//
+
+void MidiFile::setCompactEncoding(bool state) {
+	m_compactencoding = state;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getCompactEncoding -- Return true if MIDI files are written
+//     with running status.
+//
+
+bool MidiFile::getCompactEncoding(void) const {
+	return m_compactencoding;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setErrorStream -- Set the stream where error and warning
+//     messages are printed (std::cerr by default).  Use NULL to discard
+//     them, or a std::ostringstream to collect them for each file when
+//     processing many files in one program.
+//
+
+void MidiFile::setErrorStream(std::ostream* out) {
+	m_errorstream = out;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getErrorStream -- Return the stream for error and warning
+//     messages.  A stream which discards everything is returned if the
+//     messages are turned off.
+//
+
+std::ostream& MidiFile::getErrorStream(void) const {
+	static thread_local std::ostream nullstream(NULL);
+	if (m_errorstream == NULL) {
+		return nullstream;
+	}
+	if (_TrackErrors != NULL) {
+		return *_TrackErrors;
+	}
+	return *m_errorstream;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setThreadCount -- Set the maximum number of threads used to
+//     process tracks in parallel, such as when reading and writing a file
+//     or sorting the tracks.  A value of 1 (the default) does everything
+//     in the calling thread.  A value of 0 uses the number of hardware
+//     threads.  Apart from reading, the tracks are only processed in
+//     parallel if the file has enough events (see setParallelThreshold()).
+//
+
+void MidiFile::setThreadCount(int count) {
+	if (count <= 0) {
+		count = (int)std::thread::hardware_concurrency();
+	}
+	m_threadcount = count < 1 ? 1 : count;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getThreadCount -- Return the maximum number of threads used
+//     to process tracks in parallel.
+//
+
+int MidiFile::getThreadCount(void) const {
+	return m_threadcount;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::setParallelThreshold -- Set the minimum number of events
+//     (in all tracks) for which tracks are processed in parallel.  Smaller
+//     files are processed in the calling thread, since starting threads
+//     would take longer than the work itself.  Default value is 10,000.
+//
+
+void MidiFile::setParallelThreshold(int events) {
+	m_parallelthreshold = events < 0 ? 0 : events;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::getParallelThreshold -- Return the minimum number of events
+//     for which tracks are processed in parallel.
+//
+
+int MidiFile::getParallelThreshold(void) const {
+	return m_parallelthreshold;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::isParallel -- Return true if the tracks should be processed
+//     in parallel: more than one thread is allowed, there is more than
+//     one track, and there are at least the threshold number of events.
+//
+
+bool MidiFile::isParallel(void) const {
+	if ((m_threadcount <= 1) || (getTrackCount() <= 1)) {
+		return false;
+	}
+	int count = 0;
+	for (int i=0; i<getTrackCount(); i++) {
+		if (m_events[i] != NULL) {
+			count += m_events[i]->getEventCount();
+		}
+	}
+	return count >= m_parallelthreshold;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::forEachTrack -- Call the function with each track index.
+//     If parallel is true, the tracks are divided among up to the thread
+//     count of threads: the calling thread and workers from a pool which
+//     is shared by all MidiFiles and kept running between calls.  The
+//     function must then only change the given track, and its error
+//     messages are printed in track order once all threads finish.
+//     Otherwise the tracks are processed in order in the calling thread.
+//
+
+void MidiFile::forEachTrack(const std::function<void(int)>& function,
+		bool parallel) {
+	int tracks = getTrackCount();
+	int threadcount = parallel ? std::min(m_threadcount, tracks) : 1;
+	if (threadcount <= 1) {
+		for (int i=0; i<tracks; i++) {
+			function(i);
+		}
+		return;
+	}
+	_TrackJob job(function, tracks);
+	_TrackPool::getPool().run(job, threadcount);
+	for (int i=0; i<tracks; i++) {
+		if (job.m_messages[i].tellp() > 0) {
+			getErrorStream() << job.m_messages[i].str();
+		}
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::scan -- Read only the header of a Standard MIDI File and
+//      the text meta messages in its first track (such as the title or
+//      roll metadata).  The other tracks are skipped by the chunk sizes
+//      given in the file, so they are left empty, but the track count
+//      and ticks per quarter note are set as for read().  Files with
+//      incorrect track chunk sizes cannot be scanned.  Binasc input is
+//      not allowed.
+//
+
+bool MidiFile::scan(const std::string& filename) {
+	m_timemapvalid = 0;
+	setFilename(filename);
+	m_rwstatus = true;
+
+	std::fstream input;
+	input.open(filename.c_str(), std::ios::binary | std::ios::in);
+
+	if (!input.is_open()) {
+		m_rwstatus = false;
+		return m_rwstatus;
+	}
+
+	m_rwstatus = scan(input);
+	return m_rwstatus;
+}
+
+//
+// istream version of scan().
+//
+
+bool MidiFile::scan(std::istream& input) {
+	m_rwstatus = true;
+	int tracks;
+	if (!readHeaderChunk(input, tracks)) {
+		m_rwstatus = false; return m_rwstatus;
+	}
+	allocateTracks(tracks);
+
+	ulong length;
+	for (int i=0; i<tracks; i++) {
+		if (!readTrackChunkHeader(input, length)) {
+			m_rwstatus = false; return m_rwstatus;
+		}
+		if (i == 0) {
+			if (!readTrackEvents(input, *m_events[i], i, length, true)) {
+				m_rwstatus = false; return m_rwstatus;
+			}
+		} else if (!skipTrackChunk(input, length)) {
+			getErrorStream() << "In file " << getFilename() << ": cannot skip track "
+			     << i << std::endl;
+			m_rwstatus = false; return m_rwstatus;
+		}
+	}
+
+	m_theTimeState = TIME_STATE_ABSOLUTE;
+	markSequence();
+	return m_rwstatus;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::readHeaderChunk -- Read the MThd chunk of a Standard MIDI
+//      File, storing the ticks per quarter note.  The number of tracks
+//      in the file is returned in the tracks parameter.  Returns false
+//      if the header is not valid.
+//
+
+bool MidiFile::readHeaderChunk(std::istream& input, int& tracks) {
 	std::string filename = getFilename();
 
 	int    character;
-	// uchar  buffer[123456] = {0};
 	ulong  longdata;
 	ushort shortdata;
 
@@ -206,59 +845,59 @@ bool MidiFile::read(std::istream& input) {
 
 	character = input.get();
 	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'M' at first byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'M' at first byte, but found nothing." << std::endl;
+		return false;
 	} else if (character != 'M') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'M' at first byte but got '"
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'M' at first byte but got '"
 		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		return false;
 	}
 
 	character = input.get();
 	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'T' at second byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'T' at second byte, but found nothing." << std::endl;
+		return false;
 	} else if (character != 'T') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'T' at second byte but got '"
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'T' at second byte but got '"
 		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		return false;
 	}
 
 	character = input.get();
 	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'h' at third byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'h' at third byte, but found nothing." << std::endl;
+		return false;
 	} else if (character != 'h') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'h' at third byte but got '"
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'h' at third byte but got '"
 		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		return false;
 	}
 
 	character = input.get();
 	if (character == EOF) {
-		std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-		std::cerr << "Expecting 'd' at fourth byte, but found nothing." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'd' at fourth byte, but found nothing." << std::endl;
+		return false;
 	} else if (character != 'd') {
-		std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-		std::cerr << "Expecting 'd' at fourth byte but got '"
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'd' at fourth byte but got '"
 		     << (char)character << "'" << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		return false;
 	}
 
 	// read header size (allow larger header size?)
 	longdata = readLittleEndian4Bytes(input);
 	if (longdata != 6) {
-		std::cerr << "File " << filename
+		getErrorStream() << "File " << filename
 		     << " is not a MIDI 1.0 Standard MIDI file." << std::endl;
-		std::cerr << "The header size is " << longdata << " bytes." << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		getErrorStream() << "The header size is " << longdata << " bytes." << std::endl;
+		return false;
 	}
 
 	// Header parameter #1: format type
@@ -275,32 +914,20 @@ bool MidiFile::read(std::istream& input) {
 			// Type-2 MIDI files should probably be allowed as well,
 			// but I have never seen one in the wild to test with.
 		default:
-			std::cerr << "Error: cannot handle a type-" << shortdata
+			getErrorStream() << "Error: cannot handle a type-" << shortdata
 			     << " MIDI file" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
+			return false;
 	}
 
 	// Header parameter #2: track count
-	int tracks;
 	shortdata = readLittleEndian2Bytes(input);
 	if (type == 0 && shortdata != 1) {
-		std::cerr << "Error: Type 0 MIDI file can only contain one track" << std::endl;
-		std::cerr << "Instead track count is: " << shortdata << std::endl;
-		m_rwstatus = false; return m_rwstatus;
+		getErrorStream() << "Error: Type 0 MIDI file can only contain one track" << std::endl;
+		getErrorStream() << "Instead track count is: " << shortdata << std::endl;
+		return false;
 	} else {
 		tracks = shortdata;
 	}
-	clear();
-	if (m_events[0] != NULL) {
-		delete m_events[0];
-	}
-	m_events.resize(tracks);
-	for (int z=0; z<tracks; z++) {
-		m_events[z] = new MidiEventList;
-		m_events[z]->reserve(10000);   // Initialize with 10,000 event storage.
-		m_events[z]->clear();
-	}
-
 	// Header parameter #3: Ticks per quarter note
 	shortdata = readLittleEndian2Bytes(input);
 	if (shortdata >= 0x8000) {
@@ -312,8 +939,8 @@ bool MidiFile::read(std::istream& input) {
 			case 29:  framespersecond = 29; break;  // really 29.97 for color television
 			case 30:  framespersecond = 30; break;
 			default:
-					std::cerr << "Warning: unknown FPS: " << framespersecond << std::endl;
-					std::cerr << "Using non-standard FPS: " << framespersecond << std::endl;
+					getErrorStream() << "Warning: unknown FPS: " << framespersecond << std::endl;
+					getErrorStream() << "Using non-standard FPS: " << framespersecond << std::endl;
 		}
 		m_ticksPerQuarterNote = framespersecond * subframes;
 
@@ -324,137 +951,181 @@ bool MidiFile::read(std::istream& input) {
 		m_ticksPerQuarterNote = shortdata;
 	}
 
+	return true;
+}
 
-	//////////////////////////////////////////////////
-	//
-	// now read individual tracks:
-	//
 
-	uchar runningCommand;
-	MidiEvent event;
-	std::vector<uchar> bytes;
-	int xstatus;
-	// int barline;
 
-	for (int i=0; i<tracks; i++) {
-		runningCommand = 0;
+//////////////////////////////
+//
+// MidiFile::readTrackChunkHeader -- Read the ID and size of an MTrk
+//      chunk.  Returns false if the chunk ID is not valid.
+//
 
-		// std::cout << "\nReading Track: " << i + 1 << flush;
+bool MidiFile::readTrackChunkHeader(std::istream& input, ulong& length) {
+	std::string filename = getFilename();
+	int character;
 
-		// read track header...
+	character = input.get();
+	if (character == EOF) {
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'M' at first byte in track, but found nothing."
+		     << std::endl;
+		return false;
+	} else if (character != 'M') {
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'M' at first byte in track but got '"
+		     << (char)character << "'" << std::endl;
+		return false;
+	}
 
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'M' at first byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'M') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'M' at first byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		}
+	character = input.get();
+	if (character == EOF) {
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'T' at second byte in track, but found nothing."
+		     << std::endl;
+		return false;
+	} else if (character != 'T') {
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'T' at second byte in track but got '"
+		     << (char)character << "'" << std::endl;
+		return false;
+	}
 
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'T' at second byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'T') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'T' at second byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		}
+	character = input.get();
+	if (character == EOF) {
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'r' at third byte in track, but found nothing."
+		     << std::endl;
+		return false;
+	} else if (character != 'r') {
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'r' at third byte in track but got '"
+		     << (char)character << "'" << std::endl;
+		return false;
+	}
 
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'r' at third byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'r') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'r' at third byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		}
+	character = input.get();
+	if (character == EOF) {
+		getErrorStream() << "In file " << filename << ": unexpected end of file." << std::endl;
+		getErrorStream() << "Expecting 'k' at fourth byte in track, but found nothing."
+		     << std::endl;
+		return false;
+	} else if (character != 'k') {
+		getErrorStream() << "File " << filename << " is not a MIDI file" << std::endl;
+		getErrorStream() << "Expecting 'k' at fourth byte in track but got '"
+		     << (char)character << "'" << std::endl;
+		return false;
+	}
 
-		character = input.get();
-		if (character == EOF) {
-			std::cerr << "In file " << filename << ": unexpected end of file." << std::endl;
-			std::cerr << "Expecting 'k' at fourth byte in track, but found nothing."
-			     << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		} else if (character != 'k') {
-			std::cerr << "File " << filename << " is not a MIDI file" << std::endl;
-			std::cerr << "Expecting 'k' at fourth byte in track but got '"
-			     << (char)character << "'" << std::endl;
-			m_rwstatus = false; return m_rwstatus;
-		}
+	// Now read track chunk size.  It is only used as a hint when reading
+	// since the track MUST end with an end of track meta event, and
+	// many MIDI files found in the wild do not correctly give the
+	// track size.
+	length = readLittleEndian4Bytes(input);
+	if (input.eof()) {
+		getErrorStream() << "In file " << getFilename()
+		     << ": unexpected end of file in track size." << std::endl;
+		return false;
+	}
+	return true;
+}
 
-		// Now read track chunk size and throw it away because it is
-		// not really necessary since the track MUST end with an
-		// end of track meta event, and many MIDI files found in the wild
-		// do not correctly give the track size.
-		longdata = readLittleEndian4Bytes(input);
-
-		// set the size of the track allocation so that it might
-		// approximately fit the data.
-		m_events[i]->reserve((int)longdata/2);
-		m_events[i]->clear();
-
-		// process the track
-		int absticks = 0;
-		// barline = 1;
-		while (!input.eof()) {
-			longdata = readVLValue(input);
-			//std::cout << "ticks = " << longdata << std::endl;
-			absticks += longdata;
-			xstatus = extractMidiData(input, bytes, runningCommand);
-			if (xstatus == 0) {
-				m_rwstatus = false;  return m_rwstatus;
-			}
-			event.setMessage(bytes);
-			//std::cout << "command = " << std::hex << (int)event.data[0] << std::dec << std::endl;
-			if (bytes[0] == 0xff && (bytes[1] == 1 ||
-					bytes[1] == 2 || bytes[1] == 3 || bytes[1] == 4)) {
-				// mididata.push_back('\0');
-				// std::cout << '\t';
-				// for (int m=0; m<event.data[2]; m++) {
-				//    std::cout << event.data[m+3];
-				// }
-				// std::cout.flush();
-			} else if (bytes[0] == 0xff && bytes[1] == 0x2f) {
-				// end of track message
-				// uncomment out the following three lines if you don't want
-				// to see the end of track message (which is always required,
-				// and added automatically when a MIDI is written.
-				event.tick = absticks;
-				event.track = i;
-				m_events[i]->push_back(event);
-				break;
-			}
 
-			if (bytes[0] != 0xff && bytes[0] != 0xf0) {
-				event.tick = absticks;
-				event.track = i;
-				m_events[i]->push_back(event);
-			} else {
-				event.tick = absticks;
-				event.track = i;
-				m_events[i]->push_back(event);
-			}
 
+//////////////////////////////
+//
+// MidiFile::readTrackEvents -- Read the events of a track chunk into
+//      the given track list (after the chunk header has been read).  Reading
+//      stops at the end-of-track meta message.  If textonly is true, only
+//      text meta messages (and the end-of-track message) are stored.
+//      Returns false if there is a problem reading the MIDI data.
+//
+
+bool MidiFile::readTrackEvents(std::istream& input, MidiEventList& events,
+		int track, ulong length, bool textonly) {
+	uchar runningCommand = 0;
+	MidiEvent event;
+	std::vector<uchar> bytes;
+	int xstatus;
+	ulong longdata;
+
+	// set the size of the track allocation so that it might
+	// approximately fit the data.
+	if (!textonly) {
+		events.reserve((int)length/2);
+	}
+	events.clear();
+
+	// process the track
+	int absticks = 0;
+	// barline = 1;
+	while (!input.eof()) {
+		longdata = readVLValue(input);
+		//std::cout << "ticks = " << longdata << std::endl;
+		absticks += longdata;
+		xstatus = extractMidiData(input, bytes, runningCommand);
+		if (xstatus == 0) {
+			return false;
+		}
+		event.setMessage(bytes);
+		//std::cout << "command = " << std::hex << (int)event.data[0] << std::dec << std::endl;
+		if (bytes[0] == 0xff && (bytes[1] == 1 ||
+				bytes[1] == 2 || bytes[1] == 3 || bytes[1] == 4)) {
+			// mididata.push_back('\0');
+			// std::cout << '\t';
+			// for (int m=0; m<event.data[2]; m++) {
+			//    std::cout << event.data[m+3];
+			// }
+			// std::cout.flush();
+		} else if (bytes[0] == 0xff && bytes[1] == 0x2f) {
+			// end of track message
+			// uncomment out the following three lines if you don't want
+			// to see the end of track message (which is always required,
+			// and added automatically when a MIDI is written.
+			event.tick = absticks;
+			event.track = track;
+			events.push_back(event);
+			break;
+		}
+
+		if (textonly && !((bytes[0] == 0xff) && (bytes[1] >= 0x01)
+				&& (bytes[1] <= 0x0f))) {
+			continue;
+		}
+		if (bytes[0] != 0xff && bytes[0] != 0xf0) {
+			event.tick = absticks;
+			event.track = track;
+			events.push_back(event);
+		} else {
+			event.tick = absticks;
+			event.track = track;
+			events.push_back(event);
 		}
 
 	}
 
-	m_theTimeState = TIME_STATE_ABSOLUTE;
-	markSequence();
-	return m_rwstatus;
+
+	return true;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::skipTrackChunk -- Move past the contents of a track chunk
+//      (after the chunk header has been read).  Returns false if the
+//      end of the input is reached.
+//
+
+bool MidiFile::skipTrackChunk(std::istream& input, ulong length) {
+	input.seekg(length, std::ios::cur);
+	if (input.fail()) {
+		// not a seekable stream
+		input.clear();
+		input.ignore(length);
+	}
+	return !input.fail();
 }
 
 
@@ -469,7 +1140,7 @@ bool MidiFile::write(const std::string& filename) {
 	std::fstream output(filename.c_str(), std::ios::binary | std::ios::out);
 
 	if (!output.is_open()) {
-		std::cerr << "Error: could not write: " << filename << std::endl;
+		getErrorStream() << "Error: could not write: " << filename << std::endl;
 		return false;
 	}
 	m_rwstatus = write(output);
@@ -482,11 +1153,20 @@ bool MidiFile::write(const std::string& filename) {
 //
 
 bool MidiFile::write(std::ostream& out) {
-	int oldTimeState = getTickState();
-	if (oldTimeState == TIME_STATE_ABSOLUTE) {
-		makeDeltaTicks();
-	}
+	return writeFile(out, NULL);
+}
+
+
 
+//////////////////////////////
+//
+// MidiFile::writeFile -- Write a standard MIDI file to an output stream.
+//    If firsttrack is not NULL, its events are written in place of the
+//    first track, which lets derived classes add messages to the output
+//    without changing the file.
+//
+
+bool MidiFile::writeFile(std::ostream& out, const MidiEventList* firsttrack) {
 	// write the header of the Standard MIDI File
 	char ch;
 	// 1. The characters "MThd"
@@ -514,77 +1194,200 @@ bool MidiFile::write(std::ostream& out) {
 	writeBigEndianUShort(out, shortdata);
 
 	// now write each track.
-	std::vector<uchar> trackdata;
-	uchar endoftrack[4] = {0, 0xff, 0x2f, 0x00};
-	int i, j, k;
-	int size;
-	for (i=0; i<getNumTracks(); i++) {
-		trackdata.reserve(123456);   // make the track data larger than
-		                             // expected data input
-		trackdata.clear();
-		for (j=0; j<(int)m_events[i]->size(); j++) {
-			if ((*m_events[i])[j].empty()) {
-				// Don't write empty m_events (probably a delete message).
-				continue;
-			}
-			if ((*m_events[i])[j].isEndOfTrack()) {
-				// Suppress end-of-track meta messages (one will be added
-				// automatically after all track data has been written).
-				continue;
+	int tracks = getNumTracks();
+	int i;
+	std::vector<const MidiEventList*> lists(m_events.begin(), m_events.end());
+	if (firsttrack && (tracks > 0)) {
+		lists[0] = firsttrack;
+	}
+	if (isParallel()) {
+		// encode the tracks in parallel, then write them in order.
+		std::vector<std::vector<uchar>> trackdata(tracks);
+		forEachTrack([&](int track) {
+			if ((lists[track]->size() == 0) && !lists[track]->m_rawdata.empty()) {
+				return;
 			}
-			writeVLValue((*m_events[i])[j].tick, trackdata);
-			if (((*m_events[i])[j].getCommandByte() == 0xf0) ||
-					((*m_events[i])[j].getCommandByte() == 0xf7)) {
-				// 0xf0 == Complete sysex message (0xf0 is part of the raw MIDI).
-				// 0xf7 == Raw byte message (0xf7 not part of the raw MIDI).
-				// Print the first byte of the message (0xf0 or 0xf7), then
-				// print a VLV length for the rest of the bytes in the message.
-				// In other words, when creating a 0xf0 or 0xf7 MIDI message,
-				// do not insert the VLV byte length yourself, as this code will
-				// do it for you automatically.
-				trackdata.push_back((*m_events[i])[j][0]); // 0xf0 or 0xf7;
-				writeVLValue(((int)(*m_events[i])[j].size())-1, trackdata);
-				for (k=1; k<(int)(*m_events[i])[j].size(); k++) {
-					trackdata.push_back((*m_events[i])[j][k]);
-				}
+			encodeTrack(*lists[track], trackdata[track]);
+		}, true);
+		for (i=0; i<tracks; i++) {
+			if ((lists[i]->size() == 0) && !lists[i]->m_rawdata.empty()) {
+				// unparsed track (see read()): write the original data
+				writeTrackChunk(out, lists[i]->m_rawdata);
 			} else {
-				// non-sysex type of message, so just output the
-				// bytes of the message:
-				for (k=0; k<(int)(*m_events[i])[j].size(); k++) {
-					trackdata.push_back((*m_events[i])[j][k]);
-				}
+				writeTrackChunk(out, trackdata[i]);
 			}
 		}
-		size = (int)trackdata.size();
-		if ((size < 3) || !((trackdata[size-3] == 0xff)
-				&& (trackdata[size-2] == 0x2f))) {
-			trackdata.push_back(endoftrack[0]);
-			trackdata.push_back(endoftrack[1]);
-			trackdata.push_back(endoftrack[2]);
-			trackdata.push_back(endoftrack[3]);
+	} else {
+		std::vector<uchar> trackdata;
+		trackdata.reserve(123456);   // make the track data larger than
+		                             // expected data input
+		for (i=0; i<tracks; i++) {
+			if ((lists[i]->size() == 0) && !lists[i]->m_rawdata.empty()) {
+				// unparsed track (see read()): write the original data
+				writeTrackChunk(out, lists[i]->m_rawdata);
+				continue;
+			}
+			encodeTrack(*lists[i], trackdata);
+			// now ready to write to MIDI file.
+			writeTrackChunk(out, trackdata);
 		}
+	}
 
-		// now ready to write to MIDI file.
+	return true;
+}
 
-		// first write the track ID marker "MTrk":
-		ch = 'M'; out << ch;
-		ch = 'T'; out << ch;
-		ch = 'r'; out << ch;
-		ch = 'k'; out << ch;
 
-		// A. write the size of the MIDI data to follow:
-		longdata = (int)trackdata.size();
-		writeBigEndianULong(out, longdata);
 
-		// B. write the actual data
-		out.write((char*)trackdata.data(), trackdata.size());
+//////////////////////////////
+//
+// MidiFile::encodeCompactMessage -- Store a non-sysex message in the track
+//    data with running status: the command byte is left out if it is the
+//    same as the one for the previous channel message.  Note-offs with a
+//    release velocity of 0 are stored as note-ons with a velocity of 0 so
+//    that they can share the running status of the note-ons; other
+//    note-offs keep their release velocity and command.  Meta messages
+//    (and messages with the wrong number of bytes for their command)
+//    cancel running status.
+//
+
+void MidiFile::encodeCompactMessage(const MidiMessage& message,
+		uchar& runningstatus, std::vector<uchar>& trackdata) {
+	int size = (int)message.size();
+	int command = size > 0 ? message[0] : 0;
+	int expected = 0;
+	switch (command & 0xf0) {
+		case 0x80: case 0x90: case 0xa0: case 0xb0: case 0xe0:
+			expected = 3;
+			break;
+		case 0xc0: case 0xd0:
+			expected = 2;
+			break;
+	}
+	if ((expected == 0) || (size != expected)) {
+		for (int k=0; k<size; k++) {
+			trackdata.push_back(message[k]);
+		}
+		runningstatus = 0;
+		return;
 	}
 
-	if (oldTimeState == TIME_STATE_ABSOLUTE) {
-		makeAbsoluteTicks();
+	uchar status = (uchar)command;
+	uchar data2 = size > 2 ? message[2] : 0;
+	if (((status & 0xf0) == 0x80) && (data2 == 0)) {
+		status = 0x90 | (status & 0x0f);
+		data2 = 0;
+	}
+	if (status != runningstatus) {
+		trackdata.push_back(status);
+		runningstatus = status;
 	}
+	trackdata.push_back(message[1]);
+	if (size > 2) {
+		trackdata.push_back(data2);
+	}
+}
 
-	return true;
+
+
+//////////////////////////////
+//
+// MidiFile::writeTrackChunk -- Write an MTrk chunk containing the given
+//    track data.
+//
+
+void MidiFile::writeTrackChunk(std::ostream& out,
+		const std::vector<uchar>& trackdata) {
+	// first write the track ID marker "MTrk":
+	char ch;
+	ch = 'M'; out << ch;
+	ch = 'T'; out << ch;
+	ch = 'r'; out << ch;
+	ch = 'k'; out << ch;
+
+	// A. write the size of the MIDI data to follow:
+	ulong longdata = (int)trackdata.size();
+	writeBigEndianULong(out, longdata);
+
+	// B. write the actual data
+	out.write((char*)trackdata.data(), trackdata.size());
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::encodeTrack -- Store the bytes of a track chunk (without the
+//    chunk header) for a list of events in trackdata.  Absolute ticks are converted to delta
+//    ticks while encoding, so the events are not changed (the tracks
+//    may be shared with copies of the file).  An end-of-track message
+//    is added if the track does not end with one.
+//
+
+void MidiFile::encodeTrack(const MidiEventList& events,
+		std::vector<uchar>& trackdata) {
+	uchar endoftrack[4] = {0, 0xff, 0x2f, 0x00};
+	int j, k;
+	int size;
+	uchar runningstatus = 0;
+	bool absolute = (getTickState() == TIME_STATE_ABSOLUTE);
+	int lasttick = 0;
+	int deltatick;
+	trackdata.clear();
+	trackdata.reserve(events.size() * 4 + 4);
+	for (j=0; j<(int)events.size(); j++) {
+		deltatick = events[j].tick;
+		if (absolute) {
+			deltatick -= lasttick;
+			lasttick = events[j].tick;
+			if ((j > 0) && (deltatick < 0)) {
+				getErrorStream() << "Error: negative delta tick value: " << deltatick << std::endl
+				     << "Timestamps must be sorted first"
+				     << " (use MidiFile::sortTracks() before writing)." << std::endl;
+			}
+		}
+		if (events[j].empty()) {
+			// Don't write empty m_events (probably a delete message).
+			continue;
+		}
+		if (events[j].isEndOfTrack()) {
+			// Suppress end-of-track meta messages (one will be added
+			// automatically after all track data has been written).
+			continue;
+		}
+		writeVLValue(deltatick, trackdata);
+		if ((events[j].getCommandByte() == 0xf0) ||
+				(events[j].getCommandByte() == 0xf7)) {
+			// 0xf0 == Complete sysex message (0xf0 is part of the raw MIDI).
+			// 0xf7 == Raw byte message (0xf7 not part of the raw MIDI).
+			// Print the first byte of the message (0xf0 or 0xf7), then
+			// print a VLV length for the rest of the bytes in the message.
+			// In other words, when creating a 0xf0 or 0xf7 MIDI message,
+			// do not insert the VLV byte length yourself, as this code will
+			// do it for you automatically.
+			trackdata.push_back(events[j][0]); // 0xf0 or 0xf7;
+			writeVLValue(((int)events[j].size())-1, trackdata);
+			for (k=1; k<(int)events[j].size(); k++) {
+				trackdata.push_back(events[j][k]);
+			}
+			runningstatus = 0;
+		} else if (m_compactencoding) {
+			encodeCompactMessage(events[j], runningstatus, trackdata);
+		} else {
+			// non-sysex type of message, so just output the
+			// bytes of the message:
+			for (k=0; k<(int)events[j].size(); k++) {
+				trackdata.push_back(events[j][k]);
+			}
+		}
+	}
+	size = (int)trackdata.size();
+	if ((size < 3) || !((trackdata[size-3] == 0xff)
+			&& (trackdata[size-2] == 0x2f))) {
+		trackdata.push_back(endoftrack[0]);
+		trackdata.push_back(endoftrack[1]);
+		trackdata.push_back(endoftrack[2]);
+		trackdata.push_back(endoftrack[3]);
+	}
 }
 
 
@@ -602,7 +1405,7 @@ bool MidiFile::write(std::ostream& out) {
 bool MidiFile::writeHex(const std::string& filename, int width) {
 	std::fstream output(filename.c_str(), std::ios::out);
 	if (!output.is_open()) {
-		std::cerr << "Error: could not write: " << filename << std::endl;
+		getErrorStream() << "Error: could not write: " << filename << std::endl;
 		return false;
 	}
 	m_rwstatus = writeHex(output, width);
@@ -653,7 +1456,7 @@ bool MidiFile::writeBinasc(const std::string& filename) {
 	std::fstream output(filename.c_str(), std::ios::out);
 
 	if (!output.is_open()) {
-		std::cerr << "Error: could not write: " << filename << std::endl;
+		getErrorStream() << "Error: could not write: " << filename << std::endl;
 		return false;
 	}
 	m_rwstatus = writeBinasc(output);
@@ -673,6 +1476,7 @@ bool MidiFile::writeBinasc(std::ostream& output) {
 	}
 
 	Binasc binasc;
+	binasc.setErrorStream(&getErrorStream());
 	binasc.setMidiOn();
 	binarydata.seekg(0, std::ios_base::beg);
 	binasc.readFromBinary(output, binarydata);
@@ -692,7 +1496,7 @@ bool MidiFile::writeBinascWithComments(const std::string& filename) {
 	std::fstream output(filename.c_str(), std::ios::out);
 
 	if (!output.is_open()) {
-		std::cerr << "Error: could not write: " << filename << std::endl;
+		getErrorStream() << "Error: could not write: " << filename << std::endl;
 		return 0;
 	}
 	m_rwstatus = writeBinascWithComments(output);
@@ -712,6 +1516,7 @@ bool MidiFile::writeBinascWithComments(std::ostream& output) {
 	}
 
 	Binasc binasc;
+	binasc.setErrorStream(&getErrorStream());
 	binasc.setMidiOn();
 	binasc.setCommentsOn();
 	binarydata.seekg(0, std::ios_base::beg);
@@ -743,6 +1548,7 @@ bool MidiFile::status(void) const {
 //
 
 MidiEventList& MidiFile::operator[](int aTrack) {
+	ownTrack(aTrack);
 	return *m_events[aTrack];
 }
 
@@ -786,9 +1592,10 @@ int MidiFile::size(void) const {
 //
 
 void MidiFile::removeEmpties(void) {
-	for (int i=0; i<(int)m_events.size(); i++) {
-		m_events[i]->removeEmpties();
-	}
+	forEachTrack([this](int track) {
+		ownTrack(track);
+		m_events[track]->removeEmpties();
+	}, isParallel());
 }
 
 
@@ -807,10 +1614,17 @@ void MidiFile::removeEmpties(void) {
 //
 
 void MidiFile::markSequence(void) {
+	// the numbering of each track starts after the events of the
+	// previous tracks.
+	std::vector<int> starts(getTrackCount());
 	int sequence = 1;
 	for (int i=0; i<getTrackCount(); i++) {
-		sequence = operator[](i).markSequence(sequence);
+		starts[i] = sequence;
+		sequence += operator[](i).getEventCount();
 	}
+	forEachTrack([&](int track) {
+		operator[](track).markSequence(starts[track]);
+	}, isParallel());
 }
 
 //
@@ -821,7 +1635,7 @@ void MidiFile::markSequence(int track, int sequence) {
 	if ((track >= 0) && (track < getTrackCount())) {
 		operator[](track).markSequence(sequence);
 	} else {
-		std::cerr << "Warning: track " << track << " does not exist." << std::endl;
+		getErrorStream() << "Warning: track " << track << " does not exist." << std::endl;
 	}
 }
 
@@ -846,7 +1660,7 @@ void MidiFile::clearSequence(int track) {
 	if ((track >= 0) && (track < getTrackCount())) {
 		operator[](track).clearSequence();
 	} else {
-		std::cerr << "Warning: track " << track << " does not exist." << std::endl;
+		getErrorStream() << "Warning: track " << track << " does not exist." << std::endl;
 	}
 }
 
@@ -872,6 +1686,7 @@ void MidiFile::joinTracks(void) {
 		return;
 	}
 
+	ownTracks();
 	MidiEventList* joinedTrack;
 	joinedTrack = new MidiEventList;
 
@@ -923,6 +1738,7 @@ void MidiFile::splitTracks(void) {
 		makeAbsoluteTicks();
 	}
 
+	ownTrack(0);
 	int maxTrack = 0;
 	int i;
 	int length = m_events[0]->size();
@@ -978,6 +1794,7 @@ void MidiFile::splitTracksByChannel(void) {
 		makeAbsoluteTicks();
 	}
 
+	ownTrack(0);
 	int maxTrack = 0;
 	int i;
 	MidiEventList& eventlist = *m_events[0];
@@ -1115,31 +1932,26 @@ void MidiFile::makeDeltaTicks(void) {
 	if (getTickState() == TIME_STATE_DELTA) {
 		return;
 	}
-	int i, j;
-	int temp;
-	int length = getNumTracks();
-	int *timedata = new int[length];
-	for (i=0; i<length; i++) {
-		timedata[i] = 0;
-		if (m_events[i]->size() > 0) {
-			timedata[i] = (*m_events[i])[0].tick;
-		} else {
-			continue;
+	forEachTrack([this](int track) {
+		ownTrack(track);
+		MidiEventList& events = *m_events[track];
+		if (events.size() == 0) {
+			return;
 		}
-		for (j=1; j<(int)m_events[i]->size(); j++) {
-			temp = (*m_events[i])[j].tick;
-			int deltatick = temp - timedata[i];
+		int lasttick = events[0].tick;
+		for (int j=1; j<(int)events.size(); j++) {
+			int temp = events[j].tick;
+			int deltatick = temp - lasttick;
 			if (deltatick < 0) {
-				std::cerr << "Error: negative delta tick value: " << deltatick << std::endl
+				getErrorStream() << "Error: negative delta tick value: " << deltatick << std::endl
 				     << "Timestamps must be sorted first"
 				     << " (use MidiFile::sortTracks() before writing)." << std::endl;
 			}
-			(*m_events[i])[j].tick = deltatick;
-			timedata[i] = temp;
+			events[j].tick = deltatick;
+			lasttick = temp;
 		}
-	}
+	}, isParallel());
 	m_theTimeState = TIME_STATE_DELTA;
-	delete [] timedata;
 }
 
 //
@@ -1166,23 +1978,19 @@ void MidiFile::makeAbsoluteTicks(void) {
 	if (getTickState() == TIME_STATE_ABSOLUTE) {
 		return;
 	}
-	int i, j;
-	int length = getNumTracks();
-	int* timedata = new int[length];
-	for (i=0; i<length; i++) {
-		timedata[i] = 0;
-		if (m_events[i]->size() > 0) {
-			timedata[i] = (*m_events[i])[0].tick;
-		} else {
-			continue;
+	forEachTrack([this](int track) {
+		ownTrack(track);
+		MidiEventList& events = *m_events[track];
+		if (events.size() == 0) {
+			return;
 		}
-		for (j=1; j<(int)m_events[i]->size(); j++) {
-			timedata[i] += (*m_events[i])[j].tick;
-			(*m_events[i])[j].tick = timedata[i];
+		int abstick = events[0].tick;
+		for (int j=1; j<(int)events.size(); j++) {
+			abstick += events[j].tick;
+			events[j].tick = abstick;
 		}
-	}
+	}, isParallel());
 	m_theTimeState = TIME_STATE_ABSOLUTE;
-	delete [] timedata;
 }
 
 //
@@ -1240,7 +2048,7 @@ bool MidiFile::isAbsoluteTicks(void) const {
 //
 
 int MidiFile::getMaxTick(void) {
-	MidiFile& mf = *this;
+	const MidiFile& mf = *this;
 	int output = 0;
 	for (int i=0; i<mf.getTrackCount(); i++) {
 		if (mf[i].back().tick > output) {
@@ -1310,7 +2118,7 @@ double MidiFile::getFileDurationInQuarters(void) {
 
 double MidiFile::getFileDurationInSeconds(void) {
 	if (m_timemapvalid == 0) {
-		buildTimeMap();
+		doTimeAnalysis();
 		if (m_timemapvalid == 0) {
 			return -1.0;    // something went wrong
 		}
@@ -1355,11 +2163,14 @@ void MidiFile::doTimeAnalysis(void) {
 //////////////////////////////
 //
 // MidiFile::getTimeInSeconds -- return the time in seconds for
-//     the current message.
+//     the current message.  The time is calculated from the tempo
+//     segment containing the tick, so any tick can be converted
+//     (ticks after the last event continue at the final tempo).
+//     Returns -1.0 for negative ticks.
 //
 
 double MidiFile::getTimeInSeconds(int aTrack, int anIndex) {
-	return getTimeInSeconds(getEvent(aTrack, anIndex).tick);
+	return getTimeInSeconds((*m_events[aTrack])[anIndex].tick);
 }
 
 
@@ -1370,24 +2181,39 @@ double MidiFile::getTimeInSeconds(int tickvalue) {
 			return -1.0;    // something went wrong
 		}
 	}
+	if (tickvalue < 0) {
+		return -1.0;
+	}
 
-	_TickTime key;
-	key.tick    = tickvalue;
-	key.seconds = -1;
+	const _TempoSegment& segment = m_timemap[getTempoSegmentAtTick(tickvalue)];
+	return segment.seconds + (tickvalue - segment.tick) * segment.secondsPerTick;
+}
 
-	void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-			sizeof(_TickTime), ticksearch);
+//
+// Batch version of getTimeInSeconds(): convert a list of tick values
+//    into times in seconds.  When the ticks are in increasing order the
+//    list is converted in a single walk through the tempo segments.
+//
 
-	if (ptr == NULL) {
-		// The specific tick value was not found, so do a linear
-		// search for the two tick values which occur before and
-		// after the tick value, and do a linear interpolation of
-		// the time in seconds values to figure out the final
-		// time in seconds.
-		// Since the code is not yet written, kill the program at this point:
-		return linearSecondInterpolationAtTick(tickvalue);
-	} else {
-		return ((_TickTime*)ptr)->seconds;
+void MidiFile::getTimeInSeconds(const std::vector<int>& ticks,
+		std::vector<double>& output) {
+	output.resize(ticks.size());
+	if (m_timemapvalid == 0) {
+		buildTimeMap();
+		if (m_timemapvalid == 0) {
+			std::fill(output.begin(), output.end(), -1.0);
+			return;
+		}
+	}
+	int index = 0;
+	for (int i=0; i<(int)ticks.size(); i++) {
+		if (ticks[i] < 0) {
+			output[i] = -1.0;
+			continue;
+		}
+		index = getTempoSegmentAtTick(ticks[i], index);
+		const _TempoSegment& segment = m_timemap[index];
+		output[i] = segment.seconds + (ticks[i] - segment.tick) * segment.secondsPerTick;
 	}
 }
 
@@ -1397,36 +2223,23 @@ double MidiFile::getTimeInSeconds(int tickvalue) {
 //
 // MidiFile::getAbsoluteTickTime -- return the tick value represented
 //    by the input time in seconds.  If there is not tick entry at
-//    the given time in seconds, then interpolate between two values.
+//    the given time in seconds, then interpolate within the tempo
+//    segment containing the time.  Returns -1.0 for negative times.
 //
 
 double MidiFile::getAbsoluteTickTime(double starttime) {
 	if (m_timemapvalid == 0) {
 		buildTimeMap();
 		if (m_timemapvalid == 0) {
-			if (m_timemapvalid == 0) {
-				return -1.0;    // something went wrong
-			}
+			return -1.0;    // something went wrong
 		}
 	}
-
-	_TickTime key;
-	key.tick    = -1;
-	key.seconds = starttime;
-
-	void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-			sizeof(_TickTime), secondsearch);
-
-	if (ptr == NULL) {
-		// The specific seconds value was not found, so do a linear
-		// search for the two time values which occur before and
-		// after the given time value, and do a linear interpolation of
-		// the time in tick values to figure out the final time in ticks.
-		return linearTickInterpolationAtSecond(starttime);
-	} else {
-		return ((_TickTime*)ptr)->tick;
+	if (starttime < 0.0) {
+		return -1.0;
 	}
 
+	const _TempoSegment& segment = m_timemap[getTempoSegmentAtSecond(starttime)];
+	return segment.tick + (starttime - segment.seconds) / segment.secondsPerTick;
 }
 
 
@@ -1440,17 +2253,45 @@ double MidiFile::getAbsoluteTickTime(double starttime) {
 //
 // MidiFile::linkNotePairs --  Link note-ons to note-offs separately
 //     for each track.  Returns the total number of note message pairs
-//     that were linked.
+//     that were linked.  On/off controllers are not linked if notesonly
+//     is true.
+//
+
+int MidiFile::linkNotePairs(bool notesonly) {
+	std::vector<int> counts(getTrackCount(), 0);
+	forEachTrack([&](int track) {
+		if (m_events[track] != NULL) {
+			ownTrack(track);
+			counts[track] = m_events[track]->linkNotePairs(notesonly);
+		}
+	}, isParallel());
+	int sum = 0;
+	for (int i=0; i<(int)counts.size(); i++) {
+		sum += counts[i];
+	}
+	m_linkedEventsQ = true;
+	return sum;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::linkAppendedNotePairs -- Link only the events which have been
+//     appended to each track since the tracks were last linked (see
+//     MidiEventList::linkAppendedNotePairs()).  Returns the number of
+//     newly linked note pairs.
 //
 
-int MidiFile::linkNotePairs(void) {
+int MidiFile::linkAppendedNotePairs(void) {
 	int i;
 	int sum = 0;
 	for (i=0; i<getTrackCount(); i++) {
 		if (m_events[i] == NULL) {
 			continue;
 		}
-		sum += m_events[i]->linkNotePairs();
+		ownTrack(i);
+		sum += m_events[i]->linkAppendedNotePairs();
 	}
 	m_linkedEventsQ = true;
 	return sum;
@@ -1465,6 +2306,49 @@ int MidiFile::linkEventPairs(void) {
 }
 
 
+
+//////////////////////////////
+//
+// MidiFile::shiftNoteOffs -- Move all note-offs in the file by the given
+//     number of ticks, such as to lengthen every note by a fixed amount.
+//     If linkedonly is true, only note-offs linked to a note-on are moved.
+//     Since the note-offs all move together, the tracks are reordered
+//     with a merge of the moved and unmoved events rather than a full
+//     sort.  Note links are kept, and if the time analysis has been
+//     done, the times in seconds of the moved events are updated.
+//     The tracks should be in tick order before calling this function.
+//
+
+void MidiFile::shiftNoteOffs(int ticks, bool linkedonly) {
+	if (m_theTimeState != TIME_STATE_ABSOLUTE) {
+		getErrorStream() << "Warning: Shifting note-offs only allowed in absolute tick mode." << std::endl;
+		return;
+	}
+	int i, j;
+	for (i=0; i<getTrackCount(); i++) {
+		ownTrack(i);
+		MidiEventList& events = *m_events[i];
+		events.shiftNoteOffs(ticks, linkedonly);
+		if (!m_timemapvalid) {
+			continue;
+		}
+		int index = 0;
+		for (j=0; j<events.getEventCount(); j++) {
+			if (!events[j].isNoteOff()) {
+				continue;
+			}
+			if (linkedonly && !events[j].isLinked()) {
+				continue;
+			}
+			index = getTempoSegmentAtTick(events[j].tick, index);
+			const _TempoSegment& current = m_timemap[index];
+			events[j].seconds = current.seconds + (events[j].tick - current.tick)
+			                    * current.secondsPerTick;
+		}
+	}
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 //
 // filename functions --
@@ -1507,7 +2391,8 @@ const char* MidiFile::getFilename(void) const {
 MidiEvent* MidiFile::addEvent(int aTrack, int aTick,
 		std::vector<uchar>& midiData) {
 	m_timemapvalid = 0;
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->tick = aTick;
 	me->track = aTrack;
 	me->setMessage(midiData);
@@ -1524,9 +2409,11 @@ MidiEvent* MidiFile::addEvent(int aTrack, int aTick,
 
 MidiEvent* MidiFile::addEvent(MidiEvent& mfevent) {
 	if (getTrackState() == TRACK_STATE_JOINED) {
+		ownTrack(0);
 		m_events[0]->push_back(mfevent);
 		return &m_events[0]->back();
 	} else {
+		ownTrack(mfevent.track);
 		m_events.at(mfevent.track)->push_back(mfevent);
 		return &m_events.at(mfevent.track)->back();
 	}
@@ -1538,10 +2425,12 @@ MidiEvent* MidiFile::addEvent(MidiEvent& mfevent) {
 
 MidiEvent* MidiFile::addEvent(int aTrack, MidiEvent& mfevent) {
 	if (getTrackState() == TRACK_STATE_JOINED) {
+		ownTrack(0);
 		m_events[0]->push_back(mfevent);
       m_events[0]->back().track = aTrack;
 		return &m_events[0]->back();
 	} else {
+		ownTrack(aTrack);
 		m_events.at(aTrack)->push_back(mfevent);
 		m_events.at(aTrack)->back().track = aTrack;
 		return &m_events.at(aTrack)->back();
@@ -1598,7 +2487,8 @@ MidiEvent* MidiFile::addMetaEvent(int aTrack, int aTick, int aType,
 //
 
 MidiEvent* MidiFile::addText(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeText(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1613,7 +2503,8 @@ MidiEvent* MidiFile::addText(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addCopyright(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeCopyright(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1628,7 +2519,8 @@ MidiEvent* MidiFile::addCopyright(int aTrack, int aTick, const std::string& text
 //
 
 MidiEvent* MidiFile::addTrackName(int aTrack, int aTick, const std::string& name) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeTrackName(name);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1644,7 +2536,8 @@ MidiEvent* MidiFile::addTrackName(int aTrack, int aTick, const std::string& name
 
 MidiEvent* MidiFile::addInstrumentName(int aTrack, int aTick,
 		const std::string& name) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeInstrumentName(name);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1659,7 +2552,8 @@ MidiEvent* MidiFile::addInstrumentName(int aTrack, int aTick,
 //
 
 MidiEvent* MidiFile::addLyric(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeLyric(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1674,7 +2568,8 @@ MidiEvent* MidiFile::addLyric(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addMarker(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeMarker(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1689,7 +2584,8 @@ MidiEvent* MidiFile::addMarker(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addCue(int aTrack, int aTick, const std::string& text) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeCue(text);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1704,7 +2600,8 @@ MidiEvent* MidiFile::addCue(int aTrack, int aTick, const std::string& text) {
 //
 
 MidiEvent* MidiFile::addTempo(int aTrack, int aTick, double aTempo) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeTempo(aTempo);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1738,7 +2635,8 @@ MidiEvent* MidiFile::addTempo(int aTrack, int aTick, double aTempo) {
 
 MidiEvent* MidiFile::addTimeSignature(int aTrack, int aTick, int top, int bottom,
 		int clocksPerClick, int num32ndsPerQuarter) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeTimeSignature(top, bottom, clocksPerClick, num32ndsPerQuarter);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1780,7 +2678,7 @@ int MidiFile::makeVLV(uchar *buffer, int number) {
 	unsigned long value = (unsigned long)number;
 
 	if (value >= (1 << 28)) {
-		std::cerr << "Error: Meta-message size too large to handle" << std::endl;
+		getErrorStream() << "Error: Meta-message size too large to handle" << std::endl;
 		buffer[0] = 0;
 		buffer[1] = 0;
 		buffer[2] = 0;
@@ -1830,7 +2728,8 @@ int MidiFile::makeVLV(uchar *buffer, int number) {
 //
 
 MidiEvent* MidiFile::addNoteOn(int aTrack, int aTick, int aChannel, int key, int vel) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeNoteOn(aChannel, key, vel);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1846,7 +2745,8 @@ MidiEvent* MidiFile::addNoteOn(int aTrack, int aTick, int aChannel, int key, int
 
 MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key,
 		int vel) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeNoteOff(aChannel, key, vel);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1862,7 +2762,8 @@ MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key,
 //
 
 MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeNoteOff(aChannel, key);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1879,7 +2780,8 @@ MidiEvent* MidiFile::addNoteOff(int aTrack, int aTick, int aChannel, int key) {
 
 MidiEvent* MidiFile::addController(int aTrack, int aTick, int aChannel,
 		int num, int value) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makeController(aChannel, num, value);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -1896,7 +2798,8 @@ MidiEvent* MidiFile::addController(int aTrack, int aTick, int aChannel,
 
 MidiEvent* MidiFile::addPatchChange(int aTrack, int aTick, int aChannel,
 		int patchnum) {
-	MidiEvent* me = new MidiEvent;
+	ownTrack(aTrack);
+	MidiEvent* me = m_events[aTrack]->getSpareEvent();
 	me->makePatchChange(aChannel, patchnum);
 	me->tick = aTick;
 	m_events[aTrack]->push_back_no_copy(me);
@@ -2066,6 +2969,7 @@ int MidiFile::addTracks(int count) {
 //
 
 void MidiFile::allocateEvents(int track, int aSize) {
+	ownTrack(track);
 	int oldsize = m_events[track]->size();
 	if (oldsize < aSize) {
 		m_events[track]->reserve(aSize);
@@ -2088,12 +2992,12 @@ void MidiFile::deleteTrack(int aTrack) {
 	if (length == 1) {
 		return;
 	}
-	delete m_events[aTrack];
+	releaseTrack(m_events[aTrack]);
 	for (int i=aTrack; i<length-1; i++) {
 		m_events[i] = m_events[i+1];
 	}
 
-	m_events[length] = NULL;
+	m_events[length-1] = NULL;
 	m_events.resize(length-1);
 }
 
@@ -2108,9 +3012,13 @@ void MidiFile::deleteTrack(int aTrack) {
 void MidiFile::clear(void) {
 	int length = getNumTracks();
 	for (int i=0; i<length; i++) {
-		delete m_events[i];
+		releaseTrack(m_events[i]);
 		m_events[i] = NULL;
 	}
+	for (int i=0; i<(int)m_sparetracks.size(); i++) {
+		delete m_sparetracks[i];
+	}
+	m_sparetracks.clear();
 	m_events.resize(1);
 	m_events[0] = new MidiEventList;
 	m_timemapvalid=0;
@@ -2133,6 +3041,7 @@ void MidiFile::erase(void) {
 //
 
 MidiEvent& MidiFile::getEvent(int aTrack, int anIndex) {
+	ownTrack(aTrack);
 	return (*m_events[aTrack])[anIndex];
 }
 
@@ -2199,6 +3108,7 @@ int MidiFile::getNumEvents(int aTrack) const {
 //
 
 void MidiFile::mergeTracks(int aTrack1, int aTrack2) {
+	ownTracks();
 	MidiEventList* mergedTrack;
 	mergedTrack = new MidiEventList;
 	int oldTimeState = getTickState();
@@ -2216,7 +3126,7 @@ void MidiFile::mergeTracks(int aTrack1, int aTrack2) {
 
 	mergedTrack->sort();
 
-	delete m_events[aTrack1];
+	releaseTrack(m_events[aTrack1]);
 
 	m_events[aTrack1] = mergedTrack;
 
@@ -2239,11 +3149,25 @@ void MidiFile::mergeTracks(int aTrack1, int aTrack2) {
 
 //////////////////////////////
 //
-// MidiFile::setTicksPerQuarterNote --
+// MidiFile::setTicksPerQuarterNote -- Set the ticks-per-quarter-note
+//    value in the header.  Tick positions are not changed, so if the
+//    time map is up to date, event times in seconds are all scaled by
+//    the ratio of the old and new values (the tempo messages themselves
+//    do not change).  This is done in place rather than by redoing
+//    the time analysis.
 //
 
 void MidiFile::setTicksPerQuarterNote(int ticks) {
+	int oldticks = m_ticksPerQuarterNote;
 	m_ticksPerQuarterNote = ticks;
+	if ((!m_timemapvalid) || (oldticks == ticks)) {
+		return;
+	}
+	if ((oldticks <= 0) || (ticks <= 0)) {
+		m_timemapvalid = 0;
+		return;
+	}
+	rescaleTimeMap((double)oldticks / ticks);
 }
 
 //
@@ -2272,6 +3196,7 @@ void MidiFile::setTPQ(int ticks) {
 
 void MidiFile::setMillisecondTicks(void) {
 	m_ticksPerQuarterNote = 0xE728;
+	m_timemapvalid = 0;
 }
 
 
@@ -2287,9 +3212,10 @@ void MidiFile::setMillisecondTicks(void) {
 
 void MidiFile::sortTrack(int track) {
 	if ((track >= 0) && (track < getTrackCount())) {
+		ownTrack(track);
 		m_events.at(track)->sort();
 	} else {
-		std::cerr << "Warning: track " << track << " does not exist." << std::endl;
+		getErrorStream() << "Warning: track " << track << " does not exist." << std::endl;
 	}
 }
 
@@ -2302,16 +3228,29 @@ void MidiFile::sortTrack(int track) {
 
 void MidiFile::sortTracks(void) {
 	if (m_theTimeState == TIME_STATE_ABSOLUTE) {
-		for (int i=0; i<getTrackCount(); i++) {
-			m_events.at(i)->sort();
-		}
+		forEachTrack([this](int track) {
+			ownTrack(track);
+			m_events[track]->sort();
+		}, isParallel());
 	} else {
-		std::cerr << "Warning: Sorting only allowed in absolute tick mode.";
+		getErrorStream() << "Warning: Sorting only allowed in absolute tick mode." << std::endl;
 	}
 }
 
 
 
+//////////////////////////////
+//
+// MidiFile::sortEvents -- Sort a list of events which is not one of the
+//    tracks of the file in the same order as sortTracks().
+//
+
+void MidiFile::sortEvents(MidiEventList& events) {
+	events.sort();
+}
+
+
+
 //////////////////////////////
 //
 // MidiFile::getTrackCountAsType1 --  Return the number of tracks in the
@@ -2343,12 +3282,12 @@ int MidiFile::getTrackCountAsType1(void) {
 //
 
 void MidiFile::clearLinks(void) {
-	for (int i=0; i<getTrackCount(); i++) {
-		if (m_events[i] == NULL) {
-			continue;
+	forEachTrack([this](int track) {
+		if (m_events[track] != NULL) {
+			ownTrack(track);
+			m_events[track]->clearLinks();
 		}
-		m_events[i]->clearLinks();
-	}
+	}, isParallel());
 	m_linkedEventsQ = false;
 }
 
@@ -2361,221 +3300,183 @@ void MidiFile::clearLinks(void) {
 
 //////////////////////////////
 //
-// MidiFile::linearTickInterpolationAtSecond -- return the tick value at the
-//    given input time.
+// MidiFile::getTempoSegmentAtTick -- Return the index of the tempo
+//    segment which contains the given (non-negative) tick.  The search
+//    is a branch-free binary search, so it is O(log n) in the number of
+//    tempo changes.  The second form is for walking through increasing
+//    tick values: the search continues forward from the previous result,
+//    and falls back to the binary search if the tick goes backwards.
 //
 
-double MidiFile::linearTickInterpolationAtSecond(double seconds) {
-	if (m_timemapvalid == 0) {
-		buildTimeMap();
-		if (m_timemapvalid == 0) {
-			return -1.0;    // something went wrong
-		}
-	}
-
-	int i;
-	double lasttime = m_timemap[m_timemap.size()-1].seconds;
-	// give an error value of -1 if time is out of range of data.
-	if (seconds < 0.0) {
-		return -1.0;
-	}
-	if (seconds > m_timemap[m_timemap.size()-1].seconds) {
-		return -1.0;
+int MidiFile::getTempoSegmentAtTick(int tickvalue) const {
+	const _TempoSegment* base = m_timemap.data();
+	int count = (int)m_timemap.size();
+	while (count > 1) {
+		int half = count / 2;
+		base = (base[half].tick <= tickvalue) ? base + half : base;
+		count -= half;
 	}
+	return (int)(base - m_timemap.data());
+}
 
-	// Guess which side of the list is closest to target:
-	// Could do a more efficient algorithm since time values are sorted,
-	// but good enough for now...
-	int startindex = -1;
-	if (seconds < lasttime / 2) {
-		for (i=0; i<(int)m_timemap.size(); i++) {
-			if (m_timemap[i].seconds > seconds) {
-				startindex = i-1;
-				break;
-			} else if (m_timemap[i].seconds == seconds) {
-				startindex = i;
-				break;
-			}
-		}
-	} else {
-		for (i=(int)m_timemap.size()-1; i>0; i--) {
-			if (m_timemap[i].seconds < seconds) {
-				startindex = i+1;
-				break;
-			} else if (m_timemap[i].seconds == seconds) {
-				startindex = i;
-				break;
-			}
-		}
-	}
 
-	if (startindex < 0) {
-		return -1.0;
+int MidiFile::getTempoSegmentAtTick(int tickvalue, int startindex) const {
+	if ((startindex < 0) || (startindex >= (int)m_timemap.size()) ||
+			(m_timemap[startindex].tick > tickvalue)) {
+		return getTempoSegmentAtTick(tickvalue);
 	}
-	if (startindex >= (int)m_timemap.size()-1) {
-		return -1.0;
+	int lastindex = (int)m_timemap.size() - 1;
+	while ((startindex < lastindex) && (m_timemap[startindex+1].tick <= tickvalue)) {
+		startindex++;
 	}
-
-	double x1 = m_timemap[startindex].seconds;
-	double x2 = m_timemap[startindex+1].seconds;
-	double y1 = m_timemap[startindex].tick;
-	double y2 = m_timemap[startindex+1].tick;
-	double xi = seconds;
-
-	return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
+	return startindex;
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::linearSecondInterpolationAtTick -- return the time in seconds
-//    value at the given input tick time. (Ticks input could be made double).
+// MidiFile::getTempoSegmentAtSecond -- Return the index of the tempo
+//    segment which contains the given (non-negative) time in seconds.
 //
 
-double MidiFile::linearSecondInterpolationAtTick(int ticktime) {
-	if (m_timemapvalid == 0) {
-		buildTimeMap();
-		if (m_timemapvalid == 0) {
-			return -1.0;    // something went wrong
-		}
-	}
-
-	int i;
-	double lasttick = m_timemap[m_timemap.size()-1].tick;
-	// give an error value of -1 if time is out of range of data.
-	if (ticktime < 0.0) {
-		return -1;
-	}
-	if (ticktime > m_timemap.back().tick) {
-		return -1;  // don't try to extrapolate
-	}
-
-	// Guess which side of the list is closest to target:
-	// Could do a more efficient algorithm since time values are sorted,
-	// but good enough for now...
-	int startindex = -1;
-	if (ticktime < lasttick / 2) {
-		for (i=0; i<(int)m_timemap.size(); i++) {
-			if (m_timemap[i].tick > ticktime) {
-				startindex = i-1;
-				break;
-			} else if (m_timemap[i].tick == ticktime) {
-				startindex = i;
-				break;
-			}
-		}
-	} else {
-		for (i=(int)m_timemap.size()-1; i>0; i--) {
-			if (m_timemap[i].tick < ticktime) {
-				startindex = i;
-				break;
-			} else if (m_timemap[i].tick == ticktime) {
-				startindex = i;
-				break;
-			}
-		}
-	}
-
-	if (startindex < 0) {
-		return -1;
-	}
-	if (startindex >= (int)m_timemap.size()-1) {
-		return -1;
-	}
-
-	if (m_timemap[startindex].tick == ticktime) {
-		return m_timemap[startindex].seconds;
+int MidiFile::getTempoSegmentAtSecond(double seconds) const {
+	const _TempoSegment* base = m_timemap.data();
+	int count = (int)m_timemap.size();
+	while (count > 1) {
+		int half = count / 2;
+		base = (base[half].seconds <= seconds) ? base + half : base;
+		count -= half;
 	}
-
-	double x1 = m_timemap[startindex].tick;
-	double x2 = m_timemap[startindex+1].tick;
-	double y1 = m_timemap[startindex].seconds;
-	double y2 = m_timemap[startindex+1].seconds;
-	double xi = ticktime;
-
-	return (xi-x1) * ((y2-y1)/(x2-x1)) + y1;
+	return (int)(base - m_timemap.data());
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::buildTimeMap -- build an index of the absolute tick values
-//      found in a MIDI file, and their corresponding time values in
-//      seconds, taking into consideration tempo change messages.  If no
-//      tempo messages are given (or untill they are given, then the
-//      tempo is set to 120 beats per minute).  If SMPTE time code is
-//      used, then ticks are actually time values.  So don't build
-//      a time map for SMPTE ticks, and just calculate the time in
-//      seconds from the tick value (1000 ticks per second SMPTE
-//      is the only mode tested (25 frames per second and 40 subframes
-//      per frame).
+// MidiFile::buildTimeMap -- build a list of the tempo segments in the
+//      MIDI file: the starting tick of each tempo, its time in seconds,
+//      and the number of seconds per tick until the next tempo change.
+//      If no tempo messages are given (or untill they are given, then the
+//      tempo is set to 120 beats per minute).  Tempo changes are read
+//      directly from the first track (the conductor track in type-1
+//      files).  Each track is then stamped with the time in seconds of
+//      its events in a single walk through the segments.  Only a track
+//      that has been edited out of tick order will be sorted.  If SMPTE
+//      time code is used, then ticks are actually time values (1000
+//      ticks per second SMPTE is the only mode tested (25 frames per
+//      second and 40 subframes per frame).
 //
 
 void MidiFile::buildTimeMap(void) {
 
 	// convert the MIDI file to absolute time representation
-	// in single track mode (and undo if the MIDI file was not
-	// in that state when this function was called.
+	// (and undo if the MIDI file was not in that state when
+	// this function was called).
 	//
-	int trackstate = getTrackState();
-	int timestate  = getTickState();
-
+	int timestate = getTickState();
 	makeAbsoluteTicks();
-	joinTracks();
 
-	int allocsize = getNumEvents(0);
-	m_timemap.reserve(allocsize+10);
-	m_timemap.clear();
-
-	_TickTime value;
-
-	int lasttick = 0;
-	int tickinit = 0;
-
-	int i;
 	int tpq = getTicksPerQuarterNote();
 	double defaultTempo = 120.0;
-	double secondsPerTick = 60.0 / (defaultTempo * tpq);
-
-	double lastsec = 0.0;
-	double cursec = 0.0;
-
-	for (i=0; i<getNumEvents(0); i++) {
-		int curtick = getEvent(0, i).tick;
-		getEvent(0, i).seconds = cursec;
-		if ((curtick > lasttick) || !tickinit) {
-			tickinit = 1;
 
-			// calculate the current time in seconds:
-			cursec = lastsec + (curtick - lasttick) * secondsPerTick;
-			getEvent(0, i).seconds = cursec;
+	m_timemap.clear();
+	_TempoSegment segment;
+	segment.tick           = 0;
+	segment.seconds        = 0.0;
+	segment.secondsPerTick = 60.0 / (defaultTempo * tpq);
+	m_timemap.push_back(segment);
 
-			// store the new tick to second mapping
-			value.tick = curtick;
-			value.seconds = cursec;
-			m_timemap.push_back(value);
-			lasttick   = curtick;
-			lastsec    = cursec;
+	int i, j;
+	for (i=1; i<m_events[0]->getEventCount(); i++) {
+		if ((*m_events[0])[i].tick < (*m_events[0])[i-1].tick) {
+			ownTrack(0);
+			m_events[0]->sort();
+			break;
+		}
+	}
+	const MidiEventList& tempotrack = *m_events[0];
+	for (i=0; i<tempotrack.getEventCount(); i++) {
+		if (!tempotrack[i].isTempo()) {
+			continue;
+		}
+		_TempoSegment& last = m_timemap.back();
+		if (tempotrack[i].tick == last.tick) {
+			last.secondsPerTick = tempotrack[i].getTempoSPT(tpq);
+			continue;
 		}
+		segment.seconds        = last.seconds + (tempotrack[i].tick - last.tick)
+		                         * last.secondsPerTick;
+		segment.tick           = tempotrack[i].tick;
+		segment.secondsPerTick = tempotrack[i].getTempoSPT(tpq);
+		m_timemap.push_back(segment);
+	}
+	m_timemapvalid = 1;
 
-		// update the tempo if needed:
-		if (getEvent(0,i).isTempo()) {
-			secondsPerTick = getEvent(0,i).getTempoSPT(getTicksPerQuarterNote());
+	for (i=0; i<getNumTracks(); i++) {
+		MidiEventList* events = m_events[i];
+		for (j=1; j<events->getEventCount(); j++) {
+			if ((*events)[j].tick < (*events)[j-1].tick) {
+				ownTrack(i);
+				events = m_events[i];
+				events->sort();
+				break;
+			}
+		}
+		// a track shared with copies of the file is only copied if
+		// its times change.
+		bool shared = isTrackShared(i);
+		int index = 0;
+		for (j=0; j<events->getEventCount(); j++) {
+			MidiEvent& event = (*events)[j];
+			index = getTempoSegmentAtTick(event.tick, index);
+			const _TempoSegment& current = m_timemap[index];
+			double seconds = current.seconds + (event.tick - current.tick)
+			                 * current.secondsPerTick;
+			if (shared) {
+				if (event.seconds == seconds) {
+					continue;
+				}
+				ownTrack(i);
+				events = m_events[i];
+				shared = false;
+			}
+			(*events)[j].seconds = seconds;
 		}
 	}
 
-	// reset the states of the tracks or time values if necessary here:
+	// reset the time values if necessary here:
 	if (timestate == TIME_STATE_DELTA) {
 		deltaTicks();
 	}
-	if (trackstate == TRACK_STATE_SPLIT) {
-		splitTracks();
-	}
 
-	m_timemapvalid = 1;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::rescaleTimeMap -- Multiply the time in seconds of every
+//    tempo segment and event by the given factor.  Used when only the
+//    length of a tick changes, so that the time map does not have to
+//    be rebuilt.
+//
 
+void MidiFile::rescaleTimeMap(double factor) {
+	int i, j;
+	for (i=0; i<(int)m_timemap.size(); i++) {
+		m_timemap[i].seconds        *= factor;
+		m_timemap[i].secondsPerTick *= factor;
+	}
+	for (i=0; i<getNumTracks(); i++) {
+		ownTrack(i);
+		MidiEventList& events = *m_events[i];
+		int count = events.getEventCount();
+		for (j=0; j<count; j++) {
+			events[j].seconds *= factor;
+		}
+	}
 }
 
 
@@ -2596,7 +3497,7 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 
 	character = input.get();
 	if (character == EOF) {
-		std::cerr << "Error: unexpected end of file." << std::endl;
+		getErrorStream() << "Error: unexpected end of file." << std::endl;
 		return 0;
 	} else {
 		byte = (uchar)character;
@@ -2605,13 +3506,13 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 	if (byte < 0x80) {
 		runningQ = 1;
 		if (runningCommand == 0) {
-			std::cerr << "Error: running command with no previous command" << std::endl;
+			getErrorStream() << "Error: running command with no previous command" << std::endl;
 			return 0;
 		}
 		if (runningCommand >= 0xf0) {
-			std::cerr << "Error: running status not permitted with meta and sysex"
+			getErrorStream() << "Error: running status not permitted with meta and sysex"
 			     << " event." << std::endl;
-			std::cerr << "Byte is 0x" << std::hex << (int)byte << std::dec << std::endl;
+			getErrorStream() << "Byte is 0x" << std::hex << (int)byte << std::dec << std::endl;
 			return 0;
 		}
 	} else {
@@ -2633,7 +3534,7 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 			byte = readByte(input);
 			if (!status()) { return m_rwstatus; }
 			if (byte > 0x7f) {
-				std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
+				getErrorStream() << "MIDI data byte too large: " << (int)byte << std::endl;
 				m_rwstatus = false; return m_rwstatus;
 			}
 			array.push_back(byte);
@@ -2641,7 +3542,7 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 				byte = readByte(input);
 				if (!status()) { return m_rwstatus; }
 				if (byte > 0x7f) {
-					std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
+					getErrorStream() << "MIDI data byte too large: " << (int)byte << std::endl;
 					m_rwstatus = false; return m_rwstatus;
 				}
 				array.push_back(byte);
@@ -2653,7 +3554,7 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 				byte = readByte(input);
 				if (!status()) { return m_rwstatus; }
 				if (byte > 0x7f) {
-					std::cerr << "MIDI data byte too large: " << (int)byte << std::endl;
+					getErrorStream() << "MIDI data byte too large: " << (int)byte << std::endl;
 					m_rwstatus = false; return m_rwstatus;
 				}
 				array.push_back(byte);
@@ -2689,7 +3590,7 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 								if (!status()) { return m_rwstatus; }
 								array.push_back(byte4);
 								if (byte4 >= 0x80) {
-									std::cerr << "Error: cannot handle large VLVs" << std::endl;
+									getErrorStream() << "Error: cannot handle large VLVs" << std::endl;
 									m_rwstatus = false; return m_rwstatus;
 								} else {
 									length = unpackVLV(byte1, byte2, byte3, byte4);
@@ -2742,8 +3643,8 @@ int MidiFile::extractMidiData(std::istream& input, std::vector<uchar>& array,
 			}
 			break;
 		default:
-			std::cout << "Error reading midifile" << std::endl;
-			std::cout << "Command byte was " << (int)runningCommand << std::endl;
+			getErrorStream() << "Error reading midifile" << std::endl;
+			getErrorStream() << "Command byte was " << (int)runningCommand << std::endl;
 			return 0;
 	}
 	return 1;
@@ -2793,7 +3694,7 @@ ulong MidiFile::unpackVLV(uchar a, uchar b, uchar c, uchar d, uchar e) {
 	}
 	count++;
 	if (count >= 6) {
-		std::cerr << "VLV number is too large" << std::endl;
+		getErrorStream() << "VLV number is too large" << std::endl;
 		m_rwstatus = false;
 		return 0;
 	}
@@ -2821,7 +3722,7 @@ void MidiFile::writeVLValue(long aValue, std::vector<uchar>& outdata) {
 	uchar bytes[4] = {0};
 
 	if ((unsigned long)aValue >= (1 << 28)) {
-		std::cerr << "Error: number too large to convert to VLV" << std::endl;
+		getErrorStream() << "Error: number too large to convert to VLV" << std::endl;
 		aValue = 0x0FFFffff;
 	}
 
@@ -2844,65 +3745,172 @@ void MidiFile::writeVLValue(long aValue, std::vector<uchar>& outdata) {
 
 //////////////////////////////
 //
-// MidiFile::clear_no_deallocate -- Similar to clear() but does not
-//   delete the Events in the lists.  This is primarily used internally
-//   to the MidiFile class, so don't use unless you really know what you
-//   are doing (otherwise you will end up with memory leaks or
-//   segmentation faults).
+// MidiFile::recycle -- Similar to clear(), but the track lists and their
+//   MidiEvents are kept for reuse when the next file is read, so that
+//   reading many files with the same object does not need to allocate
+//   memory again.  The memory is released by clear() or when the
+//   MidiFile is deleted.
 //
 
-void MidiFile::clear_no_deallocate(void) {
-	for (int i=0; i<getTrackCount(); i++) {
-		m_events[i]->detach();
-		delete m_events[i];
-		m_events[i] = NULL;
+void MidiFile::recycle(void) {
+	for (int i=0; i<(int)m_events.size(); i++) {
+		if (m_events[i] == NULL) {
+			continue;
+		}
+		if (isTrackShared(i)) {
+			// the events belong to the copies of the file as well.
+			releaseTrack(m_events[i]);
+			m_events[i] = NULL;
+			continue;
+		}
+		m_events[i]->recycle();
+		if (i > 0) {
+			m_sparetracks.push_back(m_events[i]);
+			m_events[i] = NULL;
+		}
 	}
 	m_events.resize(1);
-	m_events[0] = new MidiEventList;
-	m_timemapvalid=0;
+	if (m_events[0] == NULL) {
+		m_events[0] = getSpareTrack();
+	}
+	m_timemapvalid = 0;
 	m_timemap.clear();
-	// m_events.resize(0);   // causes a memory leak [20150205 Jorden Thatcher]
+	m_theTrackState = TRACK_STATE_SPLIT;
+	m_theTimeState = TIME_STATE_ABSOLUTE;
+	m_linkedEventsQ = false;
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::allocateTracks -- Remove the contents of the file and set up
+//   the given number of empty tracks, reusing the previous track lists
+//   (see recycle()).
+//
+
+void MidiFile::allocateTracks(int tracks) {
+	MidiFile::recycle();
+	if (tracks < 1) {
+		m_sparetracks.push_back(m_events[0]);
+		m_events.clear();
+		return;
+	}
+	m_events.resize(tracks);
+	for (int i=1; i<tracks; i++) {
+		m_events[i] = getSpareTrack();
+	}
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::ticksearch -- for finding a tick entry in the time map.
+// MidiFile::getSpareTrack -- Return an empty track list left by
+//   recycle(), or a new one if there are none.
 //
 
-int MidiFile::ticksearch(const void* A, const void* B) {
-	_TickTime& a = *((_TickTime*)A);
-	_TickTime& b = *((_TickTime*)B);
+MidiEventList* MidiFile::getSpareTrack(void) {
+	if (m_sparetracks.empty()) {
+		return new MidiEventList;
+	}
+	MidiEventList* track = m_sparetracks.back();
+	m_sparetracks.pop_back();
+	return track;
+}
 
-	if (a.tick < b.tick) {
-		return -1;
-	} else if (a.tick > b.tick) {
-		return 1;
+
+
+//////////////////////////////
+//
+// MidiFile::isTrackShared -- Returns true if the list of events of a
+//   track is shared with a copy of the file (see operator=()).
+//
+
+bool MidiFile::isTrackShared(int track) const {
+	if ((track < 0) || (track >= (int)m_events.size()) || (m_events[track] == NULL)) {
+		return false;
 	}
-	return 0;
+	return m_events[track]->m_sharecount > 1;
 }
 
 
 
 //////////////////////////////
 //
-// MidiFile::secondsearch -- for finding a second entry in the time map.
+// MidiFile::ownTrack -- Give the file its own copy of a track which is
+//   shared with copies of the file, before the track is changed.  The
+//   copy is linked in the same way as the shared track.
 //
 
-int MidiFile::secondsearch(const void* A, const void* B) {
-	_TickTime& a = *((_TickTime*)A);
-	_TickTime& b = *((_TickTime*)B);
+void MidiFile::ownTrack(int track) {
+	if (!isTrackShared(track)) {
+		return;
+	}
+	MidiEventList* shared = m_events[track];
+	MidiEventList* copy = new MidiEventList(*shared);
+	if (m_linkedEventsQ || (shared->m_linkedcount > 0)) {
+		copy->linkNotePairs(shared->m_linknotesonly);
+	}
+	m_events[track] = copy;
+	releaseTrack(shared);
+}
 
-	if (a.seconds < b.seconds) {
-		return -1;
-	} else if (a.seconds > b.seconds) {
-		return 1;
+
+
+//////////////////////////////
+//
+// MidiFile::ownTracks -- Give the file its own copy of every shared track.
+//
+
+void MidiFile::ownTracks(void) {
+	for (int i=0; i<(int)m_events.size(); i++) {
+		ownTrack(i);
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::releaseTrack -- Delete a track list unless it is still
+//   used by another file.
+//
+
+void MidiFile::releaseTrack(MidiEventList* track) {
+	if ((track != NULL) && (--track->m_sharecount == 0)) {
+		delete track;
+	}
+}
+
+
+
+//////////////////////////////
+//
+// MidiFile::clear_no_deallocate -- Similar to clear() but does not
+//   delete the Events in the lists.  This is primarily used internally
+//   to the MidiFile class, so don't use unless you really know what you
+//   are doing (otherwise you will end up with memory leaks or
+//   segmentation faults).
+//
+
+void MidiFile::clear_no_deallocate(void) {
+	for (int i=0; i<getTrackCount(); i++) {
+		if (!isTrackShared(i)) {
+			m_events[i]->detach();
+		}
+		releaseTrack(m_events[i]);
+		m_events[i] = NULL;
 	}
-	return 0;
+	m_events.resize(1);
+	m_events[0] = new MidiEventList;
+	m_timemapvalid=0;
+	m_timemap.clear();
+	// m_events.resize(0);   // causes a memory leak [20150205 Jorden Thatcher]
 }
 
 
+
 ///////////////////////////////////////////////////////////////////////////
 //
 // Static functions:
@@ -2913,14 +3921,14 @@ int MidiFile::secondsearch(const void* A, const void* B) {
 //
 // MidiFile::readLittleEndian4Bytes -- Read four bytes which are in
 //      little-endian order (smallest byte is first).  Then flip
-//      the order of the bytes to create the return value.
+//      the order of the bytes to create the return value.  Returns 0
+//      (with the eof state set in input) if the file ends too soon.
 //
 
 ulong MidiFile::readLittleEndian4Bytes(std::istream& input) {
 	uchar buffer[4] = {0};
 	input.read((char*)buffer, 4);
 	if (input.eof()) {
-		std::cerr << "Error: unexpected end of file." << std::endl;
 		return 0;
 	}
 	return buffer[3] | (buffer[2] << 8) | (buffer[1] << 16) | (buffer[0] << 24);
@@ -2932,14 +3940,14 @@ ulong MidiFile::readLittleEndian4Bytes(std::istream& input) {
 //
 // MidiFile::readLittleEndian2Bytes -- Read two bytes which are in
 //       little-endian order (smallest byte is first).  Then flip
-//       the order of the bytes to create the return value.
+//       the order of the bytes to create the return value.  Returns 0
+//       (with the eof state set in input) if the file ends too soon.
 //
 
 ushort MidiFile::readLittleEndian2Bytes(std::istream& input) {
 	uchar buffer[2] = {0};
 	input.read((char*)buffer, 2);
 	if (input.eof()) {
-		std::cerr << "Error: unexpected end of file." << std::endl;
 		return 0;
 	}
 	return buffer[1] | (buffer[0] << 8);
@@ -2958,7 +3966,7 @@ uchar MidiFile::readByte(std::istream& input) {
 	uchar buffer[1] = {0};
 	input.read((char*)buffer, 1);
 	if (input.eof()) {
-		std::cerr << "Error: unexpected end of file." << std::endl;
+		getErrorStream() << "Error: unexpected end of file." << std::endl;
 		m_rwstatus = false;
 		return 0;
 	}
@@ -0,0 +1,157 @@
+//
+// Creation Date: Sun Oct 18 20:54:03 PDT 2026
+// Last Modified: Sun Oct 18 23:48:20 PDT 2026
+// Filename:      midi2exp/tools/alloccount.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Count the memory allocations needed to convert rolls
+//                with one reused Expressionizer and with a new one for
+//                each roll, and check that both give the same output.
+//
+// Each file is loaded into memory first and converted -n times in turn
+// with the settings given by -s as key=value overrides (such as
+// "type=green tempo=80").  Counts are printed from the third round on,
+// when the memory pools of the reused Expressionizer have grown to size
+// (its track lists only settle into their places in the second round).
+// The exit status is 1 if a reused conversion from then on needs more
+// than the fraction given by -f of the allocations of a new
+// Expressionizer, or if the outputs differ.
+//
+
+#include "Expressionizer.h"
+#include "Options.h"
+#include "RollSettings.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace smf;
+
+static atomic<long> Allocations(0);
+
+void* operator new(size_t size) {
+	Allocations++;
+	void* pointer = malloc(size ? size : 1);
+	if (!pointer) {
+		throw bad_alloc();
+	}
+	return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+	free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	free(pointer);
+}
+
+bool convert(Expressionizer& creator, const RollSettings& settings,
+             const string& input, string& output);
+
+int main(int argc, char** argv) {
+	Options options;
+	options.define("n|count=i:4", "number of times to convert each file");
+	options.define("s|settings=s", "key=value settings for the rolls");
+	options.define("f|fraction=d:0.02", "maximum fraction of the allocations of a new Expressionizer for a reused one");
+	options.process(argc, argv);
+
+	if (options.getArgCount() == 0) {
+		cerr << "Usage: " << options.getCommand()
+		     << " [-n count] [-s settings] [-f fraction] file.mid ..." << endl;
+		exit(1);
+	}
+	int count = options.getInteger("count");
+	if (count < 3) {
+		count = 3;
+	}
+	double fraction = options.getDouble("fraction");
+	RollSettings settings;
+	settings.date = RollSettings::getReproducibleDate();
+	if (!settings.setOverrides(options.getString("settings"), cerr)) {
+		exit(1);
+	}
+
+	vector<string> data;
+	for (int i=1; i<=options.getArgCount(); i++) {
+		ifstream input(options.getArg(i), ios::binary);
+		if (!input.is_open()) {
+			cerr << "Error: cannot read " << options.getArg(i) << endl;
+			exit(1);
+		}
+		stringstream contents;
+		contents << input.rdbuf();
+		data.push_back(contents.str());
+	}
+
+	int status = 0;
+	Expressionizer reused;
+	settings.setupRoll(reused, NULL);
+	for (int n=0; n<count; n++) {
+		for (int i=0; i<(int)data.size(); i++) {
+			string reusedoutput;
+			string freshoutput;
+			long start = Allocations;
+			reused.reset();
+			bool reusedstatus = convert(reused, settings, data[i], reusedoutput);
+			long reusedcount = Allocations - start;
+			start = Allocations;
+			bool freshstatus;
+			{
+				Expressionizer fresh;
+				settings.setupRoll(fresh, NULL);
+				freshstatus = convert(fresh, settings, data[i], freshoutput);
+			}
+			long freshcount = Allocations - start;
+			if (!reusedstatus || !freshstatus) {
+				cerr << "Error: cannot convert " << options.getArg(i+1) << endl;
+				status = 1;
+			} else if (reusedoutput != freshoutput) {
+				cerr << "Error: reused output differs for " << options.getArg(i+1) << endl;
+				status = 1;
+			}
+			if (n < 2) {
+				continue;
+			}
+			cout << options.getArg(i+1) << "\treused:\t" << reusedcount
+			     << "\tnew:\t" << freshcount << "\n";
+			if (reusedcount > fraction * freshcount) {
+				cerr << "Error: reused conversion of " << options.getArg(i+1)
+				     << " needs " << reusedcount << " allocations (more than "
+				     << fraction << " of " << freshcount << ")" << endl;
+				status = 1;
+			}
+		}
+	}
+	return status;
+}
+
+
+
+//////////////////////////////
+//
+// convert -- Add expression to the roll in input and store the output
+//     MIDI file bytes in output.  Warnings are printed to standard error.
+//     Returns false if the roll cannot be converted.
+//
+
+bool convert(Expressionizer& creator, const RollSettings& settings,
+		const string& input, string& output) {
+	stringstream in(input);
+	stringstream out;
+	if (!creator.readMidiFile(in) || !settings.expressRoll(creator, NULL, NULL)
+			|| !creator.writeMidiFile(out)) {
+		return false;
+	}
+	output = out.str();
+	return true;
+}
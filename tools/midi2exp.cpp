@@ -13,13 +13,35 @@
 
 #include "Expressionizer.h"
 #include "Options.h"
+#include "RollBatch.h"
+#include "RollCache.h"
+#include "RollFanout.h"
+#include "RollServer.h"
+#include "RollSettings.h"
 
 #include <stdlib.h>
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace smf;
 
+void   getRollSettings    (Options& options, RollSettings& settings);
+int    getJobCount        (Options& options);
+bool   setupCache         (Options& options, const string& name,
+                           RollCache& cache);
+void   finishCache        (RollCache* cache, const string& name, bool print);
+int    runBatch           (Options& options, const RollSettings& settings,
+                           RollCache* cache);
+int    runFanout          (Options& options, const RollSettings& settings);
+int    runServer          (Options& options, const RollSettings& settings,
+                           RollCache* cache);
+
 int main(int argc, char** argv) {
 	Options options;
 	options.define("a|adjust-hole-lengths=b", "adjust hole lengths to simulate tracker bar width");
@@ -57,121 +79,321 @@ int main(int argc, char** argv) {
 	options.define("wl|welte-loud=d:70.0", "Loud velocity");
 
 	options.define("v|version=s", "Add version number metadata");
+	options.define("date=s", "fixed date for the EXP_DATE metadata instead of the current time");
+	options.define("reproducible=b", "write identical files for identical input (date from SOURCE_DATE_EPOCH or 1970)");
 	options.define("ac|accel-ft-per-min2=d:0.2", "acceleration in feet per minute^2");
+	options.define("ae|accel-max-error=d:1.0", "maximum timing error of acceleration tempos in milliseconds");
+	options.define("z|compact=b", "write output MIDI file with running status");
+	options.define("y|remove-redundant=b", "remove controller/patch/tempo messages which change nothing");
+	options.define("redundant-report=s", "file listing the removed redundant messages (- for stdout)");
+
+	options.define("batch=s", "directory or manifest file of rolls to convert");
+	options.define("o|outdir=s", "output directory for batch mode");
+	options.define("j|jobs=i:0", "number of rolls to convert at once in batch or server mode (0 = all cores)");
+	options.define("fanout=s", "file of output variants (output and key=value settings per line) for one input file");
+	options.define("serve=s", "convert rolls sent to a Unix socket path (- for framed stdin/stdout)");
+	options.define("cache=s", "directory in which to keep converted rolls for reuse");
+	options.define("expression-cache=s", "directory in which to keep expression curves for reuse");
+	options.define("cache-size=d:1024", "maximum size of each cache directory in megabytes");
 
 	options.process(argc, argv);
 
-	Expressionizer creator;
-	creator.setupRedWelte();
-	if (options.getBoolean("green")) {
-		cout << "Processing Green Welte rolls" << endl;
-		creator.setupGreenWelte();
+	RollSettings settings;
+	getRollSettings(options, settings);
+
+	RollCache cache;
+	RollCache* cacheptr = NULL;
+	if (options.getBoolean("cache")) {
+		if (!setupCache(options, "cache", cache)) {
+			exit(1);
+		}
+		cacheptr = &cache;
 	}
-	else if (options.getBoolean("licensee")) {
-		cout << "Processing Welte Licensee rolls" << endl;
-		creator.setupLicenseeWelte();
+	RollCache expressionCache;
+	if (options.getBoolean("expression-cache")) {
+		if (!setupCache(options, "expression-cache", expressionCache)) {
+			exit(1);
+		}
+		settings.expressionCache = &expressionCache;
 	}
-	else if (options.getBoolean("88-note")) {
-		cout << "Processing 88-note rolls" << endl;
-		creator.setup88Roll();
+
+	if (options.getBoolean("batch")) {
+		return runBatch(options, settings, cacheptr);
 	}
-	else if (options.getBoolean("duo-art")) {
-		cout << "Processing Duo-art rolls" << endl;
-		creator.setupDuoArt();
+	if (options.getBoolean("serve")) {
+		return runServer(options, settings, cacheptr);
 	}
-
-	creator.setPunchDiameter(options.getDouble("punch-diameter"));
-	creator.setTrackerbarDiameter(options.getDouble("trackerbar-diameter"));
-	creator.setPunchExtensionFraction(options.getDouble("punch-fraction"));
-	if (options.getBoolean("remove-expression-tracks")) {
-		creator.removeExpressionTracksOnWrite();
+	if (options.getBoolean("fanout")) {
+		return runFanout(options, settings);
 	}
 
 	if (options.getArgCount() == 0) {
 		cerr << "Error: cannot read from standard input yet." << endl;
 		exit(1);
 	}
-	if (options.getArgCount() >= 1) {
-		creator.readMidiFile(options.getArg(1));
+	if (options.getArgCount() < 2) {
+		cerr << "Error: cannot write to standard input yet." << endl;
+		exit(1);
 	}
 
-	// default acceleration is 0.2, except for red Welte rolls
-	// green welte default tempo is 72.2222 if not specified.
-	if (options.getBoolean("red-welte")) {
-		creator.setRollTempo(94.6);    //94.6
-		cout << "setting red welte tempo 94.6" << endl;
-		creator.setAcceleration(0.3147);
+	ofstream report;
+	ostream* reportstream = NULL;
+	string reportname = options.getString("redundant-report");
+	if (reportname == "-") {
+		reportstream = &cout;
+	} else if (!reportname.empty()) {
+		report.open(reportname);
+		if (!report.is_open()) {
+			cerr << "Error: cannot write " << reportname << endl;
+			exit(1);
+		}
+		reportstream = &report;
 	}
-	else if (options.getBoolean("green-welte")){
-		creator.setRollTempo(72.2);
-		cout << "setting green welte tempo 72.2" << endl;
-	}
-	// welte licensee tempo to be 79.8 by examining the test roll
-	else if (options.getBoolean("licensee-welte")){
-		creator.setRollTempo(79.8);
-		cout << "setting welte licensee tempo 79.8" << endl;
-	}
-	else if (options.getBoolean("88-note")){
-		creator.setRollTempo(60);
-		cout << "setting 88-note roll tempo 60" << endl;
-	}
-	else if (options.getBoolean("duo-art")){
-		creator.setRollTempo(70);
-		cout << "setting duo-art roll tempo 70" << endl;
+
+	ostream* expression = options.getBoolean("print-expression") ? &cout : NULL;
+	if (!settings.convertRoll(options.getArg(1), options.getArg(2), &cout,
+			reportstream, cerr, cacheptr, expression,
+			options.getBoolean("display-extended-expression-info"))) {
+		exit(1);
 	}
-	else if (options.getBoolean("tempo")) {
-		creator.setRollTempo(options.getDouble("tempo"));
+	finishCache(cacheptr, "Cache", false);
+	finishCache(settings.expressionCache, "Expression cache", false);
+	return 0;
+}
+
+
+
+//////////////////////////////
+//
+// getRollSettings -- Store the command-line options for converting
+//     rolls in settings.
+//
+
+void getRollSettings(Options& options, RollSettings& settings) {
+	if (options.getBoolean("green")) {
+		settings.type = "green";
+		settings.typeTempo = true;
+	} else if (options.getBoolean("licensee")) {
+		settings.type = "licensee";
+		settings.typeTempo = true;
+	} else if (options.getBoolean("88-note")) {
+		settings.type = "88-note";
+		settings.typeTempo = true;
+	} else if (options.getBoolean("duo-art")) {
+		settings.type = "duo-art";
+		settings.typeTempo = true;
+	} else if (options.getBoolean("red-welte")) {
+		settings.typeTempo = true;
 	}
 
-	if (options.getBoolean("welte-piano")) {
-		creator.setWelteP(options.getDouble("welte-piano"));
+	settings.tempoQ = options.getBoolean("tempo");
+	settings.tempo = options.getDouble("tempo");
+	settings.accelQ = options.getBoolean("accel-ft-per-min2");
+	settings.accel = options.getDouble("accel-ft-per-min2");
+	settings.accelMaxErrorQ = options.getBoolean("accel-max-error");
+	settings.accelMaxError = options.getDouble("accel-max-error");
+	settings.punchDiameter = options.getDouble("punch-diameter");
+	settings.trackerDiameter = options.getDouble("trackerbar-diameter");
+	settings.punchFraction = options.getDouble("punch-fraction");
+	settings.removeTracks = options.getBoolean("remove-expression-tracks");
+	settings.adjustHoles = options.getBoolean("adjust-hole-lengths");
+	settings.compact = options.getBoolean("compact");
+	settings.removeRedundant = options.getBoolean("remove-redundant")
+			|| options.getBoolean("redundant-report");
+	settings.versionQ = options.getBoolean("version");
+	settings.version = options.getString("version");
+	if (options.getBoolean("date")) {
+		settings.date = options.getString("date");
+	} else if (options.getBoolean("reproducible")) {
+		settings.date = RollSettings::getReproducibleDate();
 	}
-	if (options.getBoolean("welte-mezzo-forte")) {
-		creator.setWelteMF(options.getDouble("welte-mezzo-forte"));
+
+	const char* parameters[] = {"welte-piano", "welte-mezzo-forte",
+			"welte-forte", "welte-loud", "slow-decay-rate", "fast-crescendo",
+			"fast-decrescendo"};
+	for (int i=0; i<7; i++) {
+		if (options.getBoolean(parameters[i])) {
+			settings.parameters.emplace_back(parameters[i], options.getDouble(parameters[i]));
+		}
 	}
-	if (options.getBoolean("welte-forte")) {
-		creator.setWelteF(options.getDouble("welte-forte"));
+}
+
+
+
+//////////////////////////////
+//
+// getJobCount -- Return the number of threads for batch, fan-out and
+//     server mode (-j), or the number of cores if it is not given.
+//
+
+int getJobCount(Options& options) {
+	int count = options.getInteger("jobs");
+	if (count <= 0) {
+		count = (int)thread::hardware_concurrency();
 	}
-	if (options.getBoolean("welte-loud")) {
-		creator.setWelteLoud(options.getDouble("welte-loud"));
+	return max(1, count);
+}
+
+
+
+//////////////////////////////
+//
+// setupCache -- Set the directory of a cache from the named command-line
+//     option, and its size.  Returns false if the directory cannot be
+//     used.
+//
+
+bool setupCache(Options& options, const string& name, RollCache& cache) {
+	if (!cache.setDirectory(options.getString(name))) {
+		return false;
 	}
+	cache.setMaxSize((long long)(options.getDouble("cache-size") * 1024.0 * 1024.0));
+	return true;
+}
 
-	if (options.getBoolean("slow-decay-rate")) {
-		creator.setSlowDecayRate(options.getDouble("slow-decay-rate"));
+
+
+//////////////////////////////
+//
+// finishCache -- Remove the least recently used entries of a cache if
+//     anything was stored in it, and print its statistics to standard
+//     error if requested.  Nothing is done if cache is NULL.
+//
+
+void finishCache(RollCache* cache, const string& name, bool print) {
+	if (!cache) {
+		return;
 	}
-	if (options.getBoolean("fast-crescendo")) {
-		creator.setFastCrescendo(options.getDouble("fast-crescendo"));
+	if (cache->getStores() > 0) {
+		cache->evict();
 	}
-	if (options.getBoolean("fast-decrescendo")) {
-		creator.setFastDecrescendo(options.getDouble("fast-decrescendo"));
+	if (print) {
+		cerr << name << ": ";
+		cache->printStatistics(cerr) << endl;
 	}
+}
 
-	if (options.getArgCount() < 2) {
-		cerr << "Error: cannot write to standard input yet." << endl;
-		exit(1);
-	}
-	if (options.getBoolean("adjust-hole-lengths")) {
-		creator.applyTrackBarWidthCorrection();
+
+
+//////////////////////////////
+//
+// runBatch -- Convert all of the rolls in a directory or manifest file
+//     (see RollBatch).  A result line (status, input, output and seconds)
+//     is printed for each roll in input order.  Returns the exit status.
+//
+
+int runBatch(Options& options, const RollSettings& settings,
+		RollCache* cache) {
+	string source = options.getString("batch");
+	string outdir = options.getString("outdir");
+	RollBatch batch;
+	if (RollBatch::isDirectory(source)) {
+		if (outdir.empty()) {
+			cerr << "Error: an output directory (-o) is needed for batch directory input" << endl;
+			return 1;
+		}
+		if (!batch.readDirectory(source, outdir, settings, cerr)) {
+			return 1;
+		}
+	} else if (!batch.readManifest(source, outdir, settings, cerr)) {
+		return 1;
 	}
 
-	if (options.getBoolean("version")) {
-		creator.setVersion(options.getString("version"));
+	string reportname = options.getString("redundant-report");
+	ofstream report;
+	if (!reportname.empty() && (reportname != "-")) {
+		report.open(reportname);
+		if (!report.is_open()) {
+			cerr << "Error: cannot write " << reportname << endl;
+			return 1;
+		}
 	}
 
-	if (options.getBoolean("accel-ft-per-min2")) {
-		creator.setAcceleration(options.getDouble("accel-ft-per-min2"));
+	batch.convert(getJobCount(options), cache, !reportname.empty());
+
+	vector<RollJob>& jobs = batch.getJobs();
+	int failures = 0;
+	for (int i=0; i<(int)jobs.size(); i++) {
+		cout << (jobs[i].status ? "ok" : "error") << "\t" << jobs[i].input << "\t"
+		     << jobs[i].output << "\t" << jobs[i].seconds << "\n";
+		if (!jobs[i].status) {
+			failures++;
+		}
+		// error messages are printed per roll so that they do not mix
+		istringstream errors(jobs[i].errors);
+		string line;
+		while (getline(errors, line)) {
+			cerr << jobs[i].input << ": " << line << "\n";
+		}
+		if (!jobs[i].report.empty()) {
+			ostream& out = reportname == "-" ? cout : report;
+			out << "# " << jobs[i].input << "\n" << jobs[i].report;
+		}
 	}
+	cout.flush();
+	cerr << "Converted " << (jobs.size() - failures) << " of " << jobs.size()
+	     << " rolls" << endl;
+	finishCache(reportname.empty() ? cache : NULL, "Cache", true);
+	finishCache(settings.expressionCache, "Expression cache", true);
+	return failures ? 1 : 0;
+}
 
-	creator.addExpression();
-	creator.setPianoTimbre();
-	creator.writeMidiFile(options.getArg(2));
-	//creator.printVelocity();   // for debug
 
-	if (options.getBoolean("print-expression")) {
-		creator.printExpression(cout, options.getBoolean("display-extended-expression-info"));
+
+//////////////////////////////
+//
+// runFanout -- Convert the input file into each of the variants listed in
+//     the --fanout file (see RollFanout).  A result line is printed for
+//     each variant in the order of the file.  Returns the exit status.
+//
+
+int runFanout(Options& options, const RollSettings& settings) {
+	if (options.getArgCount() != 1) {
+		cerr << "Error: --fanout needs one input file" << endl;
+		return 1;
 	}
+	RollFanout fanout;
+	if (!fanout.readVariants(options.getString("fanout"), options.getArg(1),
+			settings, cerr)) {
+		return 1;
+	}
+	fanout.convert(getJobCount(options), settings.expressionCache);
 
-	return 0;
+	vector<RollJob>& jobs = fanout.getJobs();
+	int failures = 0;
+	for (int i=0; i<(int)jobs.size(); i++) {
+		cout << (jobs[i].status ? "ok" : "error") << "\t" << jobs[i].input << "\t"
+		     << jobs[i].output << "\t" << jobs[i].seconds << "\n";
+		if (!jobs[i].status) {
+			failures++;
+		}
+		istringstream errors(jobs[i].errors);
+		string line;
+		while (getline(errors, line)) {
+			cerr << jobs[i].output << ": " << line << "\n";
+		}
+	}
+	cout.flush();
+	return failures ? 1 : 0;
 }
 
 
+
+//////////////////////////////
+//
+// runServer -- Convert the rolls sent to the --serve socket path (or
+//     through standard input and output for "-") until the program is
+//     stopped (see RollServer).  The statistics of the server are printed
+//     at the end.  Returns the exit status.
+//
+
+int runServer(Options& options, const RollSettings& settings,
+		RollCache* cache) {
+	RollServer server;
+	server.setDefaults(settings);
+	server.setCache(cache);
+	bool status = server.run(options.getString("serve"), getJobCount(options), cerr);
+	finishCache(settings.expressionCache, "Expression cache", false);
+	cerr << server.getStatistics();
+	return status ? 0 : 1;
+}
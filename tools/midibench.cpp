@@ -0,0 +1,267 @@
+//
+// Creation Date: Sun Oct 18 22:05:37 PDT 2026
+// Last Modified: Sun Oct 18 22:05:37 PDT 2026
+// Filename:      midi2exp/tools/midibench.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Time reading, writing and editing MIDI files with one
+//                thread and with parallel track processing, and check
+//                that both give the same results.
+//
+// Each file is loaded into memory first so that only the processing is
+// timed.  Use -n to set the number of times each file is processed, -t to
+// set the thread count for the parallel runs (0 = hardware threads), and
+// -e to set the minimum event count for processing tracks in parallel.
+// The cost of starting and joining new threads for each parallel step is
+// printed next to the cost of handing the step to the shared worker pool.
+//
+
+#include "MidiFile.h"
+#include "Options.h"
+
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace smf;
+
+Options options;
+
+enum { TEST_READ, TEST_WRITE, TEST_EDIT, TEST_COUNT };
+
+double runTime       (const vector<string>& data, int test, int threads,
+                      int threshold, int count);
+double startupTime   (int threads, int count);
+double dispatchTime  (int threads, int count);
+void   editTracks    (MidiFile& midifile);
+bool   sameEvents    (MidiFile& a, MidiFile& b);
+
+int main(int argc, char** argv) {
+	options.define("n|count=i:10", "number of times to process each file");
+	options.define("t|threads=i:0", "number of threads for parallel processing");
+	options.define("e|events=i:0", "minimum event count for parallel processing");
+	options.process(argc, argv);
+
+	if (options.getArgCount() == 0) {
+		cerr << "Usage: " << options.getCommand()
+		     << " [-n count] [-t threads] [-e events] file.mid ..." << endl;
+		exit(1);
+	}
+	int count = options.getInteger("count");
+	if (count < 1) {
+		count = 1;
+	}
+	int threshold = options.getInteger("events");
+	MidiFile parallel;
+	parallel.setThreadCount(options.getInteger("threads"));
+	parallel.setParallelThreshold(threshold);
+	int threads = parallel.getThreadCount();
+
+	vector<string> data;
+	size_t bytes = 0;
+	int status = 0;
+	for (int i=1; i<=options.getArgCount(); i++) {
+		ifstream input(options.getArg(i), ios::binary);
+		stringstream contents;
+		contents << input.rdbuf();
+		if (!input.is_open()) {
+			cerr << "Error: cannot read " << options.getArg(i) << endl;
+			status = 1;
+			continue;
+		}
+		data.push_back(contents.str());
+		bytes += data.back().size();
+
+		MidiFile serial;
+		stringstream serialstream(data.back());
+		stringstream parallelstream(data.back());
+		serial.read(serialstream);
+		parallel.read(parallelstream);
+		if ((serial.status() != parallel.status()) || !sameEvents(serial, parallel)) {
+			cerr << "Error: parallel read differs for " << options.getArg(i) << endl;
+			status = 1;
+		}
+		stringstream serialoutput;
+		stringstream paralleloutput;
+		serial.write(serialoutput);
+		parallel.write(paralleloutput);
+		if (serialoutput.str() != paralleloutput.str()) {
+			cerr << "Error: parallel write differs for " << options.getArg(i) << endl;
+			status = 1;
+		}
+		editTracks(serial);
+		editTracks(parallel);
+		if (!sameEvents(serial, parallel)) {
+			cerr << "Error: parallel track edits differ for " << options.getArg(i) << endl;
+			status = 1;
+		}
+	}
+	if (data.empty()) {
+		return status;
+	}
+
+	const char* names[TEST_COUNT] = {"read", "write", "edit"};
+	double megabytes = (double)bytes * count / 1000000.0;
+	cout << "files:\t"   << data.size() << "\n";
+	cout << "repeats:\t" << count << "\n";
+	cout << "threads:\t" << threads << "\n";
+	if (threads > 1) {
+		cout << "thread start:\t"  << startupTime(threads, 1000) * 1000000.0
+		     << " us per step\n";
+		cout << "pool dispatch:\t" << dispatchTime(threads, 1000) * 1000000.0
+		     << " us per step\n";
+	}
+	for (int i=0; i<TEST_COUNT; i++) {
+		double serialtime = runTime(data, i, 1, threshold, count);
+		double paralleltime = runTime(data, i, threads, threshold, count);
+		cout << names[i] << " serial:\t"   << serialtime << " s\t"
+		     << megabytes / serialtime << " MB/s\n";
+		cout << names[i] << " parallel:\t" << paralleltime << " s\t"
+		     << megabytes / paralleltime << " MB/s\n";
+		cout << names[i] << " speedup:\t"  << serialtime / paralleltime << "\n";
+	}
+	return status;
+}
+
+
+
+//////////////////////////////
+//
+// runTime -- Return the number of seconds needed to read, write or edit
+//     all of the files count times with the given thread count.
+//
+
+double runTime(const vector<string>& data, int test, int threads,
+		int threshold, int count) {
+	vector<MidiFile> midifiles(test == TEST_READ ? 1 : data.size());
+	for (int i=0; i<(int)midifiles.size(); i++) {
+		midifiles[i].setThreadCount(threads);
+		midifiles[i].setParallelThreshold(threshold);
+		if (test != TEST_READ) {
+			stringstream input(data[i]);
+			midifiles[i].read(input);
+		}
+	}
+	auto start = chrono::steady_clock::now();
+	for (int n=0; n<count; n++) {
+		for (int i=0; i<(int)data.size(); i++) {
+			if (test == TEST_READ) {
+				stringstream input(data[i]);
+				midifiles[0].read(input);
+			} else if (test == TEST_WRITE) {
+				stringstream output;
+				midifiles[i].write(output);
+			} else {
+				editTracks(midifiles[i]);
+			}
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double>(end - start).count();
+}
+
+
+
+//////////////////////////////
+//
+// startupTime -- Return the number of seconds needed to start and join
+//     one less than the thread count of empty threads, which is what a
+//     parallel step would cost without the worker pool.
+//
+
+double startupTime(int threads, int count) {
+	auto start = chrono::steady_clock::now();
+	for (int n=0; n<count; n++) {
+		vector<thread> workers;
+		for (int i=1; i<threads; i++) {
+			workers.emplace_back([]() { });
+		}
+		for (int i=0; i<(int)workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double>(end - start).count() / count;
+}
+
+
+
+//////////////////////////////
+//
+// dispatchTime -- Return the number of seconds needed for one parallel
+//     step on a file with one event in each of thread count tracks, which
+//     is mostly the cost of handing the tracks to the worker pool.
+//
+
+double dispatchTime(int threads, int count) {
+	MidiFile midifile;
+	midifile.setThreadCount(threads);
+	midifile.setParallelThreshold(0);
+	midifile.addTracks(threads - 1);
+	for (int i=0; i<threads; i++) {
+		midifile.addNoteOn(i, 0, 0, 60, 64);
+	}
+	midifile.clearLinks();
+	auto start = chrono::steady_clock::now();
+	for (int n=0; n<count; n++) {
+		midifile.clearLinks();
+	}
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double>(end - start).count() / count;
+}
+
+
+
+//////////////////////////////
+//
+// editTracks -- Run the per-track processing steps which are used when
+//     converting a roll.
+//
+
+void editTracks(MidiFile& midifile) {
+	midifile.makeDeltaTicks();
+	midifile.makeAbsoluteTicks();
+	midifile.sortTracks();
+	midifile.markSequence();
+	midifile.linkNotePairs();
+	midifile.clearLinks();
+	midifile.removeEmpties();
+}
+
+
+
+//////////////////////////////
+//
+// sameEvents -- Return true if the two files contain the same events
+//     in the same order.
+//
+
+bool sameEvents(MidiFile& a, MidiFile& b) {
+	if ((a.getTicksPerQuarterNote() != b.getTicksPerQuarterNote())
+			|| (a.getTrackCount() != b.getTrackCount())) {
+		return false;
+	}
+	for (int i=0; i<a.getTrackCount(); i++) {
+		if (a[i].getEventCount() != b[i].getEventCount()) {
+			return false;
+		}
+		for (int j=0; j<a[i].getEventCount(); j++) {
+			MidiEvent& ea = a[i][j];
+			MidiEvent& eb = b[i][j];
+			if ((ea.tick != eb.tick) || (ea.track != eb.track)
+					|| (ea.seq != eb.seq)
+					|| ((vector<uchar>&)ea != (vector<uchar>&)eb)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
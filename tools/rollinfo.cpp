@@ -0,0 +1,207 @@
+//
+// Creation Date: Sun Oct 18 20:40:12 PDT 2026
+// Last Modified: Sun Oct 18 20:40:12 PDT 2026
+// Filename:      midi2exp/tools/rollinfo.cpp
+// Website:       https://github.com/pianoroll/midi2exp
+// Syntax:        C++11
+// vim:           ts=3 noexpandtab
+//
+// description:   Print the ticks per quarter note, track count and
+//                metadata of piano-roll MIDI files for cataloging.
+//                Only the header and the text messages in the first
+//                track are read from each file.
+//
+// Output is one line per file, either tab-separated values (default) or
+// JSON (-j).  In TSV output, the metadata follows the filename, TPQ and
+// track count as "KEY: value" fields, or in fixed columns for the keys
+// given with -k (e.g., -k TITLE,ROLL_TYPE), in which case a header line
+// is printed first.
+//
+
+#include "MidiRoll.h"
+#include "Options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace smf;
+
+Options options;
+
+void   printTsv          (const string& filename, MidiRoll& roll,
+                          const vector<string>& keys);
+void   printJson         (const string& filename, MidiRoll& roll);
+string cleanTsv          (const string& value);
+string escapeJson        (const string& value);
+
+int main(int argc, char** argv) {
+	options.define("j|json=b", "print output as JSON");
+	options.define("k|keys=s", "comma-separated list of metadata keys to print in TSV columns");
+	options.process(argc, argv);
+
+	if (options.getArgCount() == 0) {
+		cerr << "Usage: " << options.getCommand() << " [-j] [-k keys] file.mid ..." << endl;
+		exit(1);
+	}
+
+	vector<string> keys;
+	if (options.getBoolean("keys")) {
+		string list = options.getString("keys");
+		size_t start = 0;
+		while (start <= list.size()) {
+			size_t comma = list.find(',', start);
+			if (comma == string::npos) {
+				comma = list.size();
+			}
+			if (comma > start) {
+				keys.push_back(list.substr(start, comma - start));
+			}
+			start = comma + 1;
+		}
+	}
+
+	bool jsonQ = options.getBoolean("json");
+	if (jsonQ) {
+		cout << "[\n";
+	} else if (!keys.empty()) {
+		cout << "file\ttpq\ttracks";
+		for (int i=0; i<(int)keys.size(); i++) {
+			cout << "\t" << keys[i];
+		}
+		cout << "\n";
+	}
+
+	int status = 0;
+	bool first = true;
+	MidiRoll roll;
+	for (int i=1; i<=options.getArgCount(); i++) {
+		string filename = options.getArg(i);
+		if (!roll.scan(filename)) {
+			cerr << "Error: cannot read " << filename << endl;
+			status = 1;
+			continue;
+		}
+		if (jsonQ) {
+			if (!first) {
+				cout << ",\n";
+			}
+			printJson(filename, roll);
+		} else {
+			printTsv(filename, roll, keys);
+		}
+		first = false;
+	}
+
+	if (jsonQ) {
+		cout << "\n]\n";
+	}
+	return status;
+}
+
+
+
+//////////////////////////////
+//
+// printTsv -- Print the information for one file as a line of
+//     tab-separated values.
+//
+
+void printTsv(const string& filename, MidiRoll& roll,
+		const vector<string>& keys) {
+	cout << cleanTsv(filename) << "\t" << roll.getTPQ() << "\t"
+	     << roll.getTrackCount();
+	if (keys.empty()) {
+		vector<pair<string, string>> entries;
+		roll.getMetadata(entries);
+		for (int i=0; i<(int)entries.size(); i++) {
+			cout << "\t" << cleanTsv(entries[i].first) << ": "
+			     << cleanTsv(entries[i].second);
+		}
+	} else {
+		for (int i=0; i<(int)keys.size(); i++) {
+			cout << "\t" << cleanTsv(roll.getMetadata(keys[i]));
+		}
+	}
+	cout << "\n";
+}
+
+
+
+//////////////////////////////
+//
+// printJson -- Print the information for one file as a JSON object.
+//
+
+void printJson(const string& filename, MidiRoll& roll) {
+	vector<pair<string, string>> entries;
+	roll.getMetadata(entries);
+	cout << "{\"file\":\"" << escapeJson(filename) << "\"";
+	cout << ",\"tpq\":" << roll.getTPQ();
+	cout << ",\"tracks\":" << roll.getTrackCount();
+	cout << ",\"metadata\":{";
+	for (int i=0; i<(int)entries.size(); i++) {
+		if (i > 0) {
+			cout << ",";
+		}
+		cout << "\"" << escapeJson(entries[i].first) << "\":\""
+		     << escapeJson(entries[i].second) << "\"";
+	}
+	cout << "}}";
+}
+
+
+
+//////////////////////////////
+//
+// cleanTsv -- Replace tabs and newlines with spaces so that a value
+//     stays in a single TSV field.
+//
+
+string cleanTsv(const string& value) {
+	string output = value;
+	for (int i=0; i<(int)output.size(); i++) {
+		if ((output[i] == '\t') || (output[i] == '\n') || (output[i] == '\r')) {
+			output[i] = ' ';
+		}
+	}
+	return output;
+}
+
+
+
+//////////////////////////////
+//
+// escapeJson -- Escape a string for use inside of JSON quotes.
+//
+
+string escapeJson(const string& value) {
+	string output;
+	output.reserve(value.size());
+	char buffer[8];
+	for (int i=0; i<(int)value.size(); i++) {
+		unsigned char ch = value[i];
+		switch (ch) {
+			case '"':  output += "\\\""; break;
+			case '\\': output += "\\\\"; break;
+			case '\n': output += "\\n";  break;
+			case '\r': output += "\\r";  break;
+			case '\t': output += "\\t";  break;
+			default:
+				if (ch < 0x20) {
+					snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+					output += buffer;
+				} else {
+					output += ch;
+				}
+		}
+	}
+	return output;
+}
+
+
+
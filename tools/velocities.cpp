@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <iostream>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace smf;
@@ -38,13 +39,26 @@ int main(int argc, char** argv) {
 	options.define("g|gnuplot=b",     "print gnuplot script header");
 	options.process(argc, argv);
 
+	int bass_track = 1;
+	int treble_track = 2;
+
+	int track = bass_track;
+	if (options.getBoolean("treble")) {
+		track = treble_track;
+	}
+
+	// only parse the tempo track and the selected register track:
+	vector<bool> trackmask(track + 1, false);
+	trackmask[0] = true;
+	trackmask[track] = true;
+
 	MidiFile infile;
 
 	if (options.getArgCount() == 0) {
-		infile.read(cin);
+		infile.read(cin, trackmask);
 	} else {
 		filename = options.getArg(1);
-		infile.read(filename);
+		infile.read(filename, trackmask);
 	}
 
 	if (infile.getTrackCount() < 3) {
@@ -52,14 +66,6 @@ int main(int argc, char** argv) {
 		exit(1);
 	}
 
-	int bass_track = 1;
-	int treble_track = 2;
-
-	int track = bass_track;
-	if (options.getBoolean("treble")) {
-		track = treble_track;
-	}
-
 	bool secondsQ = options.getBoolean("seconds");
 	bool milliQ   = options.getBoolean("milliseconds");
 	bool ticksQ   = options.getBoolean("ticks");